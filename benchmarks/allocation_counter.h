@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <benchmark/benchmark.h>
+
+#ifndef BENCH_MAX_ENTITIES
+#define BENCH_MAX_ENTITIES 1000000
+#endif
+
+// Counts every allocation made through the global operator new, which
+// allocation_counter.cpp replaces for the whole benchmark executable.
+namespace allocations {
+
+uint64_t count();
+uint64_t bytes();
+
+// Started right before the timed loop; report adds the allocations and
+// bytes per iteration to the benchmark's counters
+class Counter {
+public:
+    Counter() : startCount(count()), startBytes(bytes()) {}
+
+    void report(benchmark::State& state) const {
+        state.counters["allocs/iter"] = benchmark::Counter(static_cast<double>(count() - startCount), benchmark::Counter::kAvgIterations);
+        state.counters["bytes/iter"] = benchmark::Counter(static_cast<double>(bytes() - startBytes), benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    uint64_t startCount;
+    uint64_t startBytes;
+};
+
+}
+
+// Dataset sizes 10^3, 10^4, ... up to BENCH_MAX_ENTITIES or Cap, for
+// operations that are too slow to run on the largest datasets
+template <int64_t Cap = INT64_MAX>
+void entityCounts(benchmark::internal::Benchmark* benchmark) {
+    for (int64_t count = 1000; count <= BENCH_MAX_ENTITIES && count <= Cap; count *= 10) {
+        benchmark->Arg(count);
+    }
+}
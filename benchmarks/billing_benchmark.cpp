@@ -0,0 +1,194 @@
+#include "allocation_counter.h"
+
+#include <random>
+
+#include "../lab1arch/lab1arch/lab1arch.cpp"
+
+namespace {
+
+// A store of count customers split over two standard-plan operators. Limits
+// are high enough that every action in a benchmark run is accepted.
+struct BillingDataset {
+    BillingStore store;
+    std::vector<int> units;
+    std::vector<int> ages;
+    std::vector<int32_t> others;
+    std::vector<double> amounts;
+
+    explicit BillingDataset(size_t count) {
+        std::mt19937_64 random(42);
+        std::uniform_int_distribution<int> unitDistribution(1, 60);
+        std::uniform_int_distribution<int> ageDistribution(10, 90);
+        std::uniform_int_distribution<size_t> customerDistribution(0, count - 1);
+        std::uniform_real_distribution<double> amountDistribution(0.0, 500.0);
+
+        store.addOperator(Operator(0, Money::fromDouble(0.15), Money::fromDouble(0.05), Money::fromDouble(0.02), 10));
+        store.addOperator(Operator(1, Money::fromDouble(0.12), Money::fromDouble(0.04), Money::fromDouble(0.03), 15));
+        store.reserveCustomers(count);
+        for (size_t i = 0; i < count; ++i) {
+            int age = ageDistribution(random);
+            store.addCustomer(static_cast<int>(i), "Customer " + std::to_string(i), age, static_cast<int32_t>(i % 2),
+                Money::fromDouble(1e9));
+            units.push_back(unitDistribution(random));
+            ages.push_back(age);
+            others.push_back(static_cast<int32_t>(customerDistribution(random)));
+            amounts.push_back(amountDistribution(random));
+        }
+    }
+};
+
+void BM_CalculateTalkingCost(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    const Operator& op = data.store.getOperator(0);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.units.size(); ++i) {
+            benchmark::DoNotOptimize(op.calculateTalkingCost(data.units[i], data.store.bill(i), data.ages[i]));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CalculateMessageCost(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    const Operator& op = data.store.getOperator(0);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.units.size(); ++i) {
+            const Operator& otherOperator = data.store.getOperator(data.store.getOperatorIndex(data.others[i]));
+            benchmark::DoNotOptimize(op.calculateMessageCost(data.units[i], otherOperator, data.store.bill(i), data.ages[i]));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CalculateNetworkCost(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    const Operator& op = data.store.getOperator(0);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.amounts.size(); ++i) {
+            benchmark::DoNotOptimize(op.calculateNetworkCost(data.amounts[i], data.store.bill(i)));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The batch kernels over the same events; AVX2 when built with ARCHITECTURE_NATIVE
+void BM_CalculateTalkingCostBatch(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    BillingDataset data(count);
+    const Operator& op = data.store.getOperator(0);
+    std::vector<Money> debts(count), limits(count, Money::fromDouble(1e9)), costs(count);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        op.calculateTalkingCostBatch(data.units.data(), data.ages.data(), debts.data(), limits.data(), costs.data(), count);
+        benchmark::DoNotOptimize(costs.data());
+        benchmark::ClobberMemory();
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CalculateNetworkCostBatch(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    BillingDataset data(count);
+    const Operator& op = data.store.getOperator(0);
+    std::vector<Money> debts(count), limits(count, Money::fromDouble(1e9)), costs(count);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        op.calculateNetworkCostBatch(data.amounts.data(), debts.data(), limits.data(), costs.data(), count);
+        benchmark::DoNotOptimize(costs.data());
+        benchmark::ClobberMemory();
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Talk actions of every customer priced by an ActionPricer in runs of 4096,
+// as the ActionProcessor prices its window
+void BM_ActionPricer(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    std::vector<Action> actions(data.units.size());
+    for (size_t i = 0; i < actions.size(); ++i) {
+        actions[i].type = ActionType::Talk;
+        actions[i].customer = static_cast<int32_t>(i);
+        actions[i].other = data.others[i];
+        actions[i].count = data.units[i];
+    }
+    std::vector<Money> prices(actions.size());
+    ActionPricer pricer;
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t first = 0; first < actions.size(); first += 4096) {
+            size_t last = std::min(actions.size(), first + 4096);
+            for (size_t i = first; i < last; ++i) {
+                pricer.add(actions[i], data.store.getOperatorIndex(i), &prices[i]);
+            }
+            pricer.price(data.store);
+        }
+        benchmark::DoNotOptimize(prices.data());
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Full actions through Customer, without an event sink or usage rollup
+void BM_CustomerTalk(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.units.size(); ++i) {
+            Customer other = data.store.customer(data.others[i]);
+            data.store.customer(i).talk(data.units[i], other);
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CustomerMessage(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.units.size(); ++i) {
+            Customer other = data.store.customer(data.others[i]);
+            data.store.customer(i).message(data.units[i], other);
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same with the usage rollup kept up to date
+void BM_CustomerTalkWithUsage(benchmark::State& state) {
+    BillingDataset data(static_cast<size_t>(state.range(0)));
+    data.store.getUsage().enable(86400);
+    data.store.getUsage().resize(data.store.customerCount(), data.store.operatorCount());
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < data.units.size(); ++i) {
+            Customer other = data.store.customer(data.others[i]);
+            data.store.customer(i).talk(data.units[i], other, static_cast<int64_t>(i % 86400) * 30);
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(BM_CalculateTalkingCost)->Apply(entityCounts<>);
+BENCHMARK(BM_CalculateMessageCost)->Apply(entityCounts<>);
+BENCHMARK(BM_CalculateNetworkCost)->Apply(entityCounts<>);
+BENCHMARK(BM_CalculateTalkingCostBatch)->Apply(entityCounts<>);
+BENCHMARK(BM_CalculateNetworkCostBatch)->Apply(entityCounts<>);
+BENCHMARK(BM_ActionPricer)->Apply(entityCounts<>);
+BENCHMARK(BM_CustomerTalk)->Apply(entityCounts<>);
+BENCHMARK(BM_CustomerMessage)->Apply(entityCounts<>);
+BENCHMARK(BM_CustomerTalkWithUsage)->Apply(entityCounts<>);
+
+BENCHMARK_MAIN();
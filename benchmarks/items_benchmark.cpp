@@ -0,0 +1,62 @@
+#include "allocation_counter.h"
+
+#include <memory>
+#include <random>
+
+#include "../lab3arch/lab3arch/lab3arch.cpp"
+
+namespace {
+
+// Creates and frees count items through one factory
+template <typename Factory>
+void BM_CreateItem(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    Factory factory;
+    std::vector<Item*> items(count);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < count; ++i) {
+            items[i] = factory.createItem(static_cast<int>(i), 10.0, 5, true);
+        }
+        for (Item* item : items) {
+            delete item;
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Factories picked at random through the ItemFactory interface
+void BM_CreateItemMixed(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::unique_ptr<ItemFactory> factories[] = { std::make_unique<SmallFactory>(), std::make_unique<HeavyFactory>(),
+        std::make_unique<RefrigeratedFactory>(), std::make_unique<LiquidFactory>() };
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int> factoryDistribution(0, 3);
+    std::vector<int> kinds(count);
+    for (int& kind : kinds) {
+        kind = factoryDistribution(random);
+    }
+    std::vector<Item*> items(count);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        for (size_t i = 0; i < count; ++i) {
+            items[i] = factories[kinds[i]]->createItem(static_cast<int>(i), 10.0, 5, true);
+        }
+        for (Item* item : items) {
+            delete item;
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK_TEMPLATE(BM_CreateItem, SmallFactory)->Apply(entityCounts<>);
+BENCHMARK_TEMPLATE(BM_CreateItem, HeavyFactory)->Apply(entityCounts<>);
+BENCHMARK_TEMPLATE(BM_CreateItem, RefrigeratedFactory)->Apply(entityCounts<>);
+BENCHMARK_TEMPLATE(BM_CreateItem, LiquidFactory)->Apply(entityCounts<>);
+BENCHMARK(BM_CreateItemMixed)->Apply(entityCounts<>);
+
+BENCHMARK_MAIN();
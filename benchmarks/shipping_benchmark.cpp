@@ -0,0 +1,409 @@
+#include "allocation_counter.h"
+
+#include <filesystem>
+#include <memory>
+#include <random>
+
+#include "../lab2arch/lab2arch/lab1arch.cpp"
+
+namespace {
+
+// count containers of every kind with random weights; a million of them
+// stay under the INT32_MAX weight capacity of makeShip
+std::vector<std::unique_ptr<Container>> makeContainers(size_t count) {
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int> weightDistribution(500, 2000);
+    std::vector<std::unique_ptr<Container>> containers;
+    containers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        int id = static_cast<int>(i);
+        int weight = weightDistribution(random);
+        switch (i % 3) {
+        case 0: containers.emplace_back(new BasicContainer(id, weight)); break;
+        case 1: containers.emplace_back(new RefrigeratedContainer(id, weight)); break;
+        default: containers.emplace_back(new LiquidContainer(id, weight)); break;
+        }
+    }
+    return containers;
+}
+
+Ship makeShip(size_t capacity) {
+    int maxContainers = static_cast<int>(capacity);
+    return Ship(0, INT32_MAX, maxContainers, maxContainers, maxContainers, maxContainers, 1.5);
+}
+
+void BM_ShipLoad(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        Ship ship = makeShip(containers.size());
+        for (const auto& container : containers) {
+            benchmark::DoNotOptimize(ship.load(container.get()));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Unloads in load order
+void BM_ShipUnload(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    Ship ship = makeShip(containers.size());
+    allocations::Counter counter;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (const auto& container : containers) {
+            ship.load(container.get());
+        }
+        state.ResumeTiming();
+        for (const auto& container : containers) {
+            benchmark::DoNotOptimize(ship.unLoad(container.get()));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// state.range(0) ships at a port with a tenth as many berths; every
+// iteration the oldest berthed ship leaves and arrives again, so each
+// movement admits a ship from the queue
+void BM_PortArrivalDeparture(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<std::unique_ptr<Ship>> ships;
+    for (size_t i = 0; i < count; ++i) {
+        ships.emplace_back(new Ship(1, 1000, 10, 5, 5, 5, 1.0));
+    }
+    Port port(1, 0.0, 0.0);
+    port.setBerths(std::max<size_t>(1, count / 10));
+    for (const auto& ship : ships) {
+        port.incomingShip(ship.get());
+    }
+    size_t next = 0;
+    allocations::Counter counter;
+    for (auto _ : state) {
+        Ship* ship = ships[next].get();
+        port.outgoingShip(ship);
+        port.incomingShip(ship);
+        next = next + 1 == count ? 0 : next + 1;
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+void BM_CalculateRequiredFuel(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    Ship ship = makeShip(containers.size());
+    for (const auto& container : containers) {
+        ship.load(container.get());
+    }
+    allocations::Counter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ship.CalculateRequiredFuel(1000.0));
+    }
+    counter.report(state);
+}
+
+// Fuel per km of a fleet's cargo through the class hierarchy
+void BM_FleetConsumptionVirtual(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        double total = 0;
+        for (const auto& container : containers) {
+            total += container->consumption();
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same through the packed arrays
+void BM_FleetConsumptionPacked(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    PackedContainers packed;
+    packed.reserve(containers.size());
+    for (const auto& container : containers) {
+        packed.push_back(*container);
+    }
+    allocations::Counter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(packed.consumption());
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// A year of range(0) ships sailing between 100 ports, with and without
+// cargo to move
+void BM_VoyageSimulation(benchmark::State& state) {
+    const int ships = static_cast<int>(state.range(0));
+    const bool cargo = state.range(1) != 0;
+    uint64_t events = 0;
+    allocations::Counter counter;
+    for (auto _ : state) {
+        state.PauseTiming();
+        VoyageSimulator simulator;
+        std::mt19937_64 random(42);
+        for (int port = 0; port < 100; ++port) {
+            simulator.addPort(port, static_cast<double>(random() % 140) - 60.0, static_cast<double>(random() % 360) - 180.0);
+        }
+        for (int ship = 0; ship < ships; ++ship) {
+            simulator.addShip(ship % 100, 150000, 50, 20, 10, 5, 3.0);
+        }
+        for (int container = 0; cargo && container < ships * 20; ++container) {
+            ContainerKind kind = static_cast<ContainerKind>(container % 3);
+            simulator.addContainer({ container, 500 + container % 2500, kind }, container % 100);
+        }
+        state.ResumeTiming();
+        events += simulator.run().getEvents();
+    }
+    counter.report(state);
+    state.SetItemsProcessed(static_cast<int64_t>(events));
+}
+
+// 64 small scenarios on range(0) threads
+void BM_MonteCarlo(benchmark::State& state) {
+    MonteCarloOptions options;
+    options.scenarios = 64;
+    options.threads = static_cast<unsigned>(state.range(0));
+    options.hours = 24.0 * 30;
+    allocations::Counter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MonteCarloRunner(options).run());
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(options.scenarios));
+}
+
+// A backlog of range(0) containers over range(0) / 50 ships of the three
+// presets, greedy only and with local search
+void BM_LoadPlanner(benchmark::State& state) {
+    auto containers = makeContainers(static_cast<size_t>(state.range(0)));
+    std::vector<Container*> backlog;
+    for (const auto& container : containers) {
+        backlog.push_back(container.get());
+    }
+    std::mt19937_64 random(42);
+    std::vector<std::unique_ptr<Ship>> ships;
+    std::vector<LoadPlanner::Voyage> voyages;
+    for (int64_t i = 0; i < state.range(0) / 50; ++i) {
+        const ShipPreset& preset = ShipPresets[i % 3];
+        ships.emplace_back(new Ship(0, preset.maxNumAllContainers * 1500, preset.maxNumAllContainers, preset.maxNumHeavyContainers,
+            preset.maxNumRefrigeratedContainers, preset.maxNumLiquidContainers, preset.fuelConsumptionPerKM));
+        voyages.push_back({ ships.back().get(), 100.0 + static_cast<double>(random() % 10000) });
+    }
+    LoadPlanOptions options;
+    options.localSearchIterations = static_cast<size_t>(state.range(1));
+    allocations::Counter counter;
+    size_t assigned = 0;
+    for (auto _ : state) {
+        assigned = LoadPlanner::plan(backlog, voyages, options).assigned;
+    }
+    counter.report(state);
+    state.counters["assigned"] = static_cast<double>(assigned);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// count ports spread uniformly over the globe
+std::vector<Port> makePorts(size_t count) {
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> latitudeDistribution(-80.0, 80.0);
+    std::uniform_real_distribution<double> longitudeDistribution(-180.0, 180.0);
+    std::vector<Port> ports;
+    ports.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        ports.emplace_back(static_cast<int>(i), latitudeDistribution(random), longitudeDistribution(random));
+    }
+    return ports;
+}
+
+// Pointers to every port, as Port* or const Port*
+template <typename PortPointer>
+std::vector<PortPointer> pointersTo(std::vector<Port>& ports) {
+    std::vector<PortPointer> pointers;
+    pointers.reserve(ports.size());
+    for (Port& port : ports) {
+        pointers.push_back(&port);
+    }
+    return pointers;
+}
+
+// Routes over range(0) ports: a ring plus two routes per port to random
+// ports, and queries between random ports. range(1) sets the cache size,
+// so 0 measures searches and the rest cache hits, with every query cached
+// before timing.
+void BM_RoutePlanner(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    RoutePlanner planner(static_cast<size_t>(state.range(1)));
+    for (Port& port : ports) {
+        planner.addPort(&port);
+    }
+    std::mt19937_64 random(7);
+    const int count = static_cast<int>(ports.size());
+    for (int port = 0; port < count; ++port) {
+        for (int to : { (port + 1) % count, static_cast<int>(random() % count), static_cast<int>(random() % count) }) {
+            planner.addRoute(port, to);
+        }
+    }
+    std::vector<std::pair<int, int>> queries(1024);
+    for (auto& query : queries) {
+        query = { static_cast<int>(random() % count), static_cast<int>(random() % count) };
+    }
+    planner.find(0, 1); // Picks the landmarks
+    if (state.range(1) != 0) {
+        for (const auto& query : queries) {
+            planner.find(query.first, query.second);
+        }
+    }
+    allocations::Counter counter;
+    size_t next = 0;
+    for (auto _ : state) {
+        const auto& query = queries[next++ % queries.size()];
+        benchmark::DoNotOptimize(planner.find(query.first, query.second));
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_PortIndexBuild(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    std::vector<Port*> pointers = pointersTo<Port*>(ports);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        PortIndex index(pointers);
+        benchmark::DoNotOptimize(index.size());
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The 8 ports nearest random points, and the ports within 500 km of them
+void BM_PortIndexQuery(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    PortIndex index(pointersTo<Port*>(ports));
+    std::vector<Port> points = makePorts(1024);
+    const bool radius = state.range(1) != 0;
+    allocations::Counter counter;
+    size_t next = 0;
+    for (auto _ : state) {
+        const Port& point = points[next++ % points.size()];
+        if (radius) {
+            benchmark::DoNotOptimize(index.within(point.getLatitude(), point.getLongitude(), 500.0));
+        }
+        else {
+            benchmark::DoNotOptimize(index.nearest(point.getLatitude(), point.getLongitude(), 8));
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Appends state.range(0) voyages to a log kept in memory
+void BM_VoyageLogAppend(benchmark::State& state) {
+    const int count = static_cast<int>(state.range(0));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        VoyageLog log;
+        for (int i = 0; i < count; ++i) {
+            log.append({ i % 1000, i % 97, (i + 1) % 97, i * 0.25, 10.0 + i % 13, i % 5000 });
+        }
+        benchmark::DoNotOptimize(log.size());
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Totals over the middle tenth of a log of state.range(0) voyages; with
+// range(1) set the older half is spilled to a file in the temporary
+// directory, so the scan crosses into it. The file is removed afterwards.
+void BM_VoyageLogScan(benchmark::State& state) {
+    const int count = static_cast<int>(state.range(0));
+    const std::string spillPath = (std::filesystem::temp_directory_path()
+        / ("voyage_log_benchmark_" + std::to_string(std::random_device()()) + ".bin")).string();
+    {
+        VoyageLog log;
+        if (state.range(1) != 0 && !log.spillTo(spillPath, count / VoyageChunk::ChunkSize / 2)) {
+            state.SkipWithError("Unable to create the spill file");
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            log.append({ i % 1000, i % 97, (i + 1) % 97, i * 0.25, 10.0 + i % 13, i % 5000 });
+        }
+        const double end = count * 0.25;
+        allocations::Counter counter;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(log.totals(end * 0.45, end * 0.55));
+        }
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations() * state.range(0) / 10);
+    }
+    // The log has closed the file
+    std::remove(spillPath.c_str());
+}
+
+void BM_DistanceMatrixBuild(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    std::vector<const Port*> pointers = pointersTo<const Port*>(ports);
+    allocations::Counter counter;
+    for (auto _ : state) {
+        DistanceMatrix matrix(pointers);
+        benchmark::DoNotOptimize(matrix.at(0, pointers.size() - 1));
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0) / 2);
+}
+
+void BM_DistanceMatrixLookup(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    DistanceMatrix matrix(pointersTo<const Port*>(ports));
+    std::mt19937_64 random(7);
+    std::uniform_int_distribution<int> idDistribution(0, static_cast<int>(ports.size()) - 1);
+    std::vector<std::pair<int, int>> pairs(4096);
+    for (auto& pair : pairs) {
+        pair = { idDistribution(random), idDistribution(random) };
+    }
+    allocations::Counter counter;
+    size_t next = 0;
+    for (auto _ : state) {
+        const auto& pair = pairs[next++ % pairs.size()];
+        benchmark::DoNotOptimize(matrix.between(pair.first, pair.second));
+    }
+    counter.report(state);
+}
+
+void BM_Haversine(benchmark::State& state) {
+    std::vector<Port> ports = makePorts(static_cast<size_t>(state.range(0)));
+    allocations::Counter counter;
+    for (auto _ : state) {
+        double total = 0;
+        for (const Port& port : ports) {
+            total += ports[0].getDistance(port);
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(BM_ShipLoad)->Apply(entityCounts<>);
+BENCHMARK(BM_ShipUnload)->Apply(entityCounts<>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PortArrivalDeparture)->Apply(entityCounts<>);
+BENCHMARK(BM_CalculateRequiredFuel)->Apply(entityCounts<>);
+BENCHMARK(BM_FleetConsumptionVirtual)->Apply(entityCounts<>);
+BENCHMARK(BM_FleetConsumptionPacked)->Apply(entityCounts<>);
+BENCHMARK(BM_VoyageSimulation)->ArgsProduct({ { 100, 1000 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MonteCarlo)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_LoadPlanner)->ArgsProduct({ { 10000, 100000 }, { 0, 1000000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RoutePlanner)->ArgsProduct({ { 1000, 10000, 100000 }, { 0 } })->ArgsProduct({ { 1000, 10000 }, { 4096 } });
+BENCHMARK(BM_PortIndexBuild)->Apply(entityCounts<>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PortIndexQuery)->ArgsProduct({ { 1000, 100000, 1000000 }, { 0, 1 } });
+BENCHMARK(BM_VoyageLogAppend)->Apply(entityCounts<>);
+BENCHMARK(BM_VoyageLogScan)->ArgsProduct({ { 100000, 1000000 }, { 0, 1 } });
+BENCHMARK(BM_DistanceMatrixBuild)->Apply(entityCounts<4096>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DistanceMatrixLookup)->Apply(entityCounts<4096>);
+BENCHMARK(BM_Haversine)->Apply(entityCounts<>);
+
+BENCHMARK_MAIN();
@@ -2,246 +2,3524 @@
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
+#include <charconv>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 
-using json = nlohmann::json;
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-class Operator;
+// Batch pricing uses AVX2 when the compiler targets it (/arch:AVX2, -mavx2).
+// The integer kernels need its 64-bit compares, so every other target runs
+// the branch-free scalar loop, which the compiler vectorizes where it can.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BILLING_SIMD_AVX2
+#endif
 
-class Bill {
+using json = nlohmann::json;
+
+// Fixed-point amount of money in millionths of the currency unit. Adding,
+// subtracting and comparing are exact, so totals do not depend on the order
+// of summation, the batch size or the number of threads. Rounding happens
+// only when a fractional value becomes Money, and it is always to the
+// nearest micro-unit with ties to even.
+class Money {
 private:
-    double limitingAmount;
-    double currentDebt;
+    int64_t micros;
+
+    constexpr explicit Money(int64_t micros) : micros(micros) {}
 
 public:
-    Bill(double limitingAmount) : limitingAmount(limitingAmount), currentDebt(0.0) {}
+    static constexpr int64_t MicrosPerUnit = 1000000;
+
+    constexpr Money() : micros(0) {}
+
+    static constexpr Money fromMicros(int64_t micros) {
+        return Money(micros);
+    }
 
-    bool check(double amount) {
-        return (currentDebt + amount) <= limitingAmount;
+    static Money fromDouble(double amount) {
+        return Money(roundToInteger(amount * MicrosPerUnit));
     }
 
-    void add(double amount) {
-        currentDebt += amount;
+    // Nearest integer, ties to even (the default floating-point rounding mode)
+    static int64_t roundToInteger(double value) {
+        return static_cast<int64_t>(std::nearbyint(value));
     }
 
-    void pay(double amount) {
-        if (amount > currentDebt) {
-            currentDebt = 0.0;
+    // numerator / denominator for a positive denominator, ties to even
+    static constexpr int64_t divideRounded(int64_t numerator, int64_t denominator) {
+        int64_t quotient = numerator / denominator;
+        int64_t remainder = numerator % denominator;
+        if (remainder < 0) {
+            remainder += denominator;
+            --quotient;
         }
-        else {
-            currentDebt -= amount;
+        if (2 * remainder > denominator || (2 * remainder == denominator && (quotient & 1) != 0)) {
+            ++quotient;
         }
+        return quotient;
+    }
+
+    constexpr int64_t getMicros() const {
+        return micros;
+    }
+
+    constexpr double toDouble() const {
+        return static_cast<double>(micros) / MicrosPerUnit;
+    }
+
+    // This amount reduced by a whole percentage
+    constexpr Money discounted(int percent) const {
+        return Money(divideRounded(micros * (100 - percent), 100));
     }
 
-    void changeTheLimit(double amount) {
-        limitingAmount = amount;
+    // This per-unit price applied to a fractional quantity
+    Money times(double quantity) const {
+        return Money(roundToInteger(quantity * static_cast<double>(micros)));
     }
 
-    double getLimitingAmount() const {
-        return limitingAmount;
+    constexpr Money operator+(Money other) const { return Money(micros + other.micros); }
+    constexpr Money operator-(Money other) const { return Money(micros - other.micros); }
+    constexpr Money operator*(int64_t count) const { return Money(micros * count); }
+    Money& operator+=(Money other) { micros += other.micros; return *this; }
+    Money& operator-=(Money other) { micros -= other.micros; return *this; }
+
+    constexpr bool operator==(Money other) const { return micros == other.micros; }
+    constexpr bool operator!=(Money other) const { return micros != other.micros; }
+    constexpr bool operator<(Money other) const { return micros < other.micros; }
+    constexpr bool operator<=(Money other) const { return micros <= other.micros; }
+    constexpr bool operator>(Money other) const { return micros > other.micros; }
+    constexpr bool operator>=(Money other) const { return micros >= other.micros; }
+};
+
+static_assert(sizeof(Money) == sizeof(int64_t) && std::is_standard_layout<Money>::value,
+    "Money columns are loaded as int64_t lanes by the batch kernels");
+
+// Prints like a double would (2, 1.2, 0.000001), without rounding error
+inline std::ostream& operator<<(std::ostream& out, Money amount) {
+    int64_t micros = amount.getMicros();
+    if (micros < 0) {
+        out << '-';
+        micros = -micros;
+    }
+    out << micros / Money::MicrosPerUnit;
+    int64_t fraction = micros % Money::MicrosPerUnit;
+    if (fraction != 0) {
+        int digits = 6;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            --digits;
+        }
+        out << '.' << std::setw(digits) << std::setfill('0') << fraction << std::setfill(' ');
     }
+    return out;
+}
 
-    double getCurrentDebt() const {
-        return currentDebt;
+// Appends the same digits as operator<< does
+inline void appendMoney(std::string& out, Money amount) {
+    int64_t micros = amount.getMicros();
+    if (micros < 0) {
+        out += '-';
+        micros = -micros;
+    }
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), micros / Money::MicrosPerUnit).ptr;
+    out.append(digits, end);
+    int64_t fraction = micros % Money::MicrosPerUnit;
+    if (fraction != 0) {
+        out += '.';
+        for (int64_t unit = Money::MicrosPerUnit / 10; fraction != 0; unit /= 10) {
+            out += static_cast<char>('0' + fraction / unit);
+            fraction %= unit;
+        }
     }
+}
+
+class BillingStore;
+
+// A view of one customer's bill inside the BillingStore
+class Bill {
+private:
+    BillingStore* store;
+    size_t index;
+
+public:
+    Bill(BillingStore* store, size_t index) : store(store), index(index) {}
+
+    bool check(Money amount) const;
+    void add(Money amount);
+    void pay(Money amount);
+    void changeTheLimit(Money amount);
+    Money getLimitingAmount() const;
+    Money getCurrentDebt() const;
 };
 
+enum class EventKind : uint8_t {
+    Talk,
+    Message,
+    Network
+};
+
+// Columns of N events of one kind that are priced in one call. units is read
+// for talk and message events, amounts for network events. times (seconds
+// since the start of the billing cycle) may be null for plans without
+// time-of-day rules.
+struct PricingBatch {
+    size_t count = 0;
+    const int* units = nullptr;
+    const double* amounts = nullptr;
+    const int* ages = nullptr;
+    const int* otherOperatorIDs = nullptr;
+    const int64_t* times = nullptr;
+    const Money* debts = nullptr;
+    const Money* limits = nullptr;
+    Money* costs = nullptr;
+};
+
+// Prices of a tariff plan for every combination of its discount rules, one
+// table per event kind (see RuleSet). An operator builds them once.
+struct PlanPrices {
+    static constexpr size_t MaxCombinations = 4;
+
+    std::array<Money, MaxCombinations> talk{};
+    std::array<Money, MaxCombinations> message{};
+    std::array<Money, MaxCombinations> network{};
+};
+
+// Tariffs are Money per minute, message and unit of data. The discount is
+// applied to the per-unit price once, when the operator is created, so the
+// cost of an event is an exact integer product and never depends on how
+// events are grouped into batches. Operators on the standard plan (plan 0)
+// are priced inline; any other plan from the TariffRegistry adds its own
+// discount rules, whose prices are worked out when the operator is created.
 class Operator {
 private:
     int ID;
-    double talkingCharge;
-    double messageCost;
-    double networkCharge;
+    Money talkingCharge;
+    Money messageCost;
+    Money networkCharge;
     int discountRate;
+    int plan;
+    Money discountedTalkingCharge;
+    Money discountedMessageCost;
+    PlanPrices prices;
+
+    Money priceEvent(EventKind kind, int units, double amount, int age, int otherOperatorID, int64_t time, const Bill& bill) const;
+    void buildPrices();
 
 public:
-    Operator(int ID, double talkingCharge, double messageCost, double networkCharge, int discountRate)
-        : ID(ID), talkingCharge(talkingCharge), messageCost(messageCost), networkCharge(networkCharge), discountRate(discountRate) {}
+    Operator(int ID, Money talkingCharge, Money messageCost, Money networkCharge, int discountRate, int plan = 0)
+        : ID(ID), talkingCharge(talkingCharge), messageCost(messageCost), networkCharge(networkCharge), discountRate(discountRate),
+        plan(plan), discountedTalkingCharge(talkingCharge.discounted(discountRate)), discountedMessageCost(messageCost.discounted(discountRate)) {
+        buildPrices();
+    }
 
-    double calculateTalkingCost(int minute, const Bill& bill, int age) const {
-        double cost = minute * talkingCharge;
+    Money calculateTalkingCost(int minute, const Bill& bill, int age, int64_t time = 0) const {
+        if (plan != 0) {
+            return priceEvent(EventKind::Talk, minute, 0.0, age, -1, time, bill);
+        }
+        Money cost = talkingCharge * minute;
         if (age < 18 || age > 65) {
-            cost *= (1.0 - discountRate / 100.0);
+            cost = discountedTalkingCharge * minute;
         }
         if (!bill.check(cost)) {
-            return 0.0;
+            return Money();
         }
         return cost;
     }
 
-    double calculateMessageCost(int quantity, const Operator& otherOperator, const Bill& bill, int age) const {
-        double cost = quantity * messageCost;
+    Money calculateMessageCost(int quantity, const Operator& otherOperator, const Bill& bill, int age, int64_t time = 0) const {
+        if (plan != 0) {
+            return priceEvent(EventKind::Message, quantity, 0.0, age, otherOperator.getID(), time, bill);
+        }
+        Money cost = messageCost * quantity;
         if (this == &otherOperator) {
-            cost *= (1.0 - discountRate / 100.0);
+            cost = discountedMessageCost * quantity;
         }
         if (!bill.check(cost)) {
-            return 0.0;
+            return Money();
         }
         return cost;
     }
 
-    double calculateNetworkCost(double amount, const Bill& bill) const {
-        double cost = amount * networkCharge;
+    Money calculateNetworkCost(double amount, const Bill& bill, int64_t time = 0) const {
+        if (plan != 0) {
+            return priceEvent(EventKind::Network, 0, amount, 0, -1, time, bill);
+        }
+        Money cost = networkCharge.times(amount);
         if (!bill.check(cost)) {
-            return 0.0;
+            return Money();
         }
         return cost;
     }
 
+    // Prices a batch with this operator's plan. The plan is looked up once
+    // per call and the whole batch runs in its specialized kernel.
+    void priceBatch(EventKind kind, const PricingBatch& batch) const;
+
+    // Standard-plan batch counterparts of the calculate*Cost functions: event
+    // i is priced against the bill whose debt and limit are debts[i] and
+    // limits[i], and costs[i] receives exactly what the single-event function
+    // would return. The discount and the limit check are applied as lane
+    // masks, so there is no per-event branch.
+    void calculateTalkingCostBatch(const int* minutes, const int* ages, const Money* debts, const Money* limits,
+        Money* costs, size_t count) const {
+        size_t i = 0;
+#if defined(BILLING_SIMD_AVX2)
+        if (fitsMultiplier(talkingCharge) && fitsMultiplier(discountedTalkingCharge)) {
+            const __m256i charge = _mm256_set1_epi64x(talkingCharge.getMicros());
+            const __m256i discounted = _mm256_set1_epi64x(discountedTalkingCharge.getMicros());
+            const __m128i minAge = _mm_set1_epi32(18);
+            const __m128i maxAge = _mm_set1_epi32(65);
+            for (; i + 4 <= count; i += 4) {
+                __m128i age = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ages + i));
+                __m256i discount = _mm256_cvtepi32_epi64(_mm_or_si128(_mm_cmplt_epi32(age, minAge), _mm_cmpgt_epi32(age, maxAge)));
+                __m256i units = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(minutes + i)));
+                __m256i cost = _mm256_mul_epi32(units, _mm256_blendv_epi8(charge, discounted, discount));
+                storeAllowed(costs + i, cost, debts + i, limits + i);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            Money price = (ages[i] < 18 || ages[i] > 65) ? discountedTalkingCharge : talkingCharge;
+            Money cost = price * minutes[i];
+            costs[i] = debts[i] + cost <= limits[i] ? cost : Money();
+        }
+    }
+
+    // otherOperatorIDs[i] is the operator of the receiving customer; messages
+    // within this operator get the discount
+    void calculateMessageCostBatch(const int* quantities, const int* otherOperatorIDs, const Money* debts, const Money* limits,
+        Money* costs, size_t count) const {
+        size_t i = 0;
+#if defined(BILLING_SIMD_AVX2)
+        if (fitsMultiplier(messageCost) && fitsMultiplier(discountedMessageCost)) {
+            const __m256i charge = _mm256_set1_epi64x(messageCost.getMicros());
+            const __m256i discounted = _mm256_set1_epi64x(discountedMessageCost.getMicros());
+            const __m128i self = _mm_set1_epi32(ID);
+            for (; i + 4 <= count; i += 4) {
+                __m128i other = _mm_loadu_si128(reinterpret_cast<const __m128i*>(otherOperatorIDs + i));
+                __m256i discount = _mm256_cvtepi32_epi64(_mm_cmpeq_epi32(other, self));
+                __m256i units = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(quantities + i)));
+                __m256i cost = _mm256_mul_epi32(units, _mm256_blendv_epi8(charge, discounted, discount));
+                storeAllowed(costs + i, cost, debts + i, limits + i);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            Money cost = (otherOperatorIDs[i] == ID ? discountedMessageCost : messageCost) * quantities[i];
+            costs[i] = debts[i] + cost <= limits[i] ? cost : Money();
+        }
+    }
+
+    void calculateNetworkCostBatch(const double* amounts, const Money* debts, const Money* limits,
+        Money* costs, size_t count) const {
+        size_t i = 0;
+#if defined(BILLING_SIMD_AVX2)
+        // Adding 1.5 * 2^52 rounds to an integer with ties to even and leaves
+        // it in the low mantissa bits; exact for magnitudes below 2^51
+        const __m256d charge = _mm256_set1_pd(static_cast<double>(networkCharge.getMicros()));
+        const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+        const __m256d range = _mm256_set1_pd(2251799813685248.0);
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        for (; i + 4 <= count; i += 4) {
+            __m256d exact = _mm256_mul_pd(_mm256_loadu_pd(amounts + i), charge);
+            if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign, exact), range, _CMP_LT_OQ)) != 0xF) {
+                break;
+            }
+            __m256i cost = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(exact, magic)), _mm256_castpd_si256(magic));
+            storeAllowed(costs + i, cost, debts + i, limits + i);
+        }
+#endif
+        for (; i < count; ++i) {
+            Money cost = networkCharge.times(amounts[i]);
+            costs[i] = debts[i] + cost <= limits[i] ? cost : Money();
+        }
+    }
+
     int getID() const {
         return ID;
     }
 
-    double getTalkingCharge() const {
+    Money getTalkingCharge() const {
         return talkingCharge;
     }
 
-    double getMessageCost() const {
+    Money getMessageCost() const {
         return messageCost;
     }
 
-    double getNetworkCharge() const {
+    Money getNetworkCharge() const {
         return networkCharge;
     }
 
     int getDiscountRate() const {
         return discountRate;
     }
-};
 
-class Customer {
+    int getPlan() const {
+        return plan;
+    }
+
+    const PlanPrices& getPrices() const {
+        return prices;
+    }
+
 private:
-    int ID;
-    std::string name;
-    int age;
-    Operator* operatorPtr;
-    Bill* billPtr;
+#if defined(BILLING_SIMD_AVX2)
+    // _mm256_mul_epi32 multiplies the low 32 bits of each lane
+    static bool fitsMultiplier(Money price) {
+        return price.getMicros() >= INT32_MIN && price.getMicros() <= INT32_MAX;
+    }
 
-public:
-    Customer(int ID, const std::string& name, int age, Operator* operatorPtr, Bill* billPtr)
-        : ID(ID), name(name), age(age), operatorPtr(operatorPtr), billPtr(billPtr) {}
+    // costs = debts + cost <= limits ? cost : 0
+    static void storeAllowed(Money* costs, __m256i cost, const Money* debts, const Money* limits) {
+        __m256i debt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(debts));
+        __m256i limit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(limits));
+        __m256i over = _mm256_cmpgt_epi64(_mm256_add_epi64(debt, cost), limit);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(costs), _mm256_andnot_si256(over, cost));
+    }
+#endif
+};
+
+// Discount rules of tariff plans. applies() runs for every event, so it is
+// written without branches; percent() runs once per batch and may use the
+// operator's own discount rate.
+struct AgeDiscount {
+    template <EventKind Kind>
+    static bool applies(const PricingBatch& batch, size_t i, int) {
+        return (batch.ages[i] < 18) | (batch.ages[i] > 65);
+    }
+
+    static constexpr int percent(int operatorRate) {
+        return operatorRate;
+    }
+};
+
+// Messages to a customer of the same operator
+struct OnNetDiscount {
+    template <EventKind Kind>
+    static bool applies(const PricingBatch& batch, size_t i, int operatorID) {
+        return batch.otherOperatorIDs[i] == operatorID;
+    }
+
+    static constexpr int percent(int operatorRate) {
+        return operatorRate;
+    }
+};
+
+// Events starting in [FromHour, ToHour); the window wraps past midnight when
+// FromHour > ToHour
+template <int FromHour, int ToHour, int Percent>
+struct OffPeakDiscount {
+    static_assert(FromHour >= 0 && FromHour < 24 && ToHour >= 0 && ToHour <= 24, "hours are 0-24");
 
-    void talk(int minute, Customer& other) {
-        double cost = operatorPtr->calculateTalkingCost(minute, *billPtr, age);
-        if (cost > 0.0) {
-            billPtr->add(cost);
-            other.billPtr->add(cost);
-            std::cout << name << " talked to " << other.name << " for " << minute << " minutes. Cost: $" << cost << std::endl;
+    template <EventKind Kind>
+    static bool applies(const PricingBatch& batch, size_t i, int) {
+        int hour = static_cast<int>(batch.times[i] / 3600 % 24);
+        if constexpr (FromHour > ToHour) {
+            return (hour >= FromHour) | (hour < ToHour);
         }
         else {
-            std::cout << "Talking not allowed. Exceeds bill limit." << std::endl;
+            return (hour >= FromHour) & (hour < ToHour);
         }
     }
 
-    void message(int quantity, Customer& other) {
-        double cost = operatorPtr->calculateMessageCost(quantity, *other.operatorPtr, *billPtr, age);
-        if (cost > 0.0) {
-            billPtr->add(cost);
-            other.billPtr->add(cost);
-            std::cout << name << " sent " << quantity << " messages to " << other.name << ". Cost: $" << cost << std::endl;
+    static constexpr int percent(int) {
+        return Percent;
+    }
+};
+
+// Events of at least MinUnits minutes, messages or units of data
+template <int MinUnits, int Percent>
+struct VolumeDiscount {
+    template <EventKind Kind>
+    static bool applies(const PricingBatch& batch, size_t i, int) {
+        if constexpr (Kind == EventKind::Network) {
+            return batch.amounts[i] >= MinUnits;
         }
         else {
-            std::cout << "Messaging not allowed. Exceeds bill limit." << std::endl;
+            return batch.units[i] >= MinUnits;
         }
     }
 
-    void connection(double amount) {
-        double cost = operatorPtr->calculateNetworkCost(amount, *billPtr);
-        if (cost > 0.0) {
-            billPtr->add(cost);
-            std::cout << name << " connected to the internet. Cost: $" << cost << std::endl;
+    static constexpr int percent(int) {
+        return Percent;
+    }
+};
+
+// The rules of one event kind. Every combination of rules that may apply
+// gets its price when the operator is created, so pricing an event is a
+// table lookup indexed by the rule bits followed by one exact
+// multiplication. Percentages of rules that apply together add up, to at
+// most 100.
+template <class... Rules>
+struct RuleSet {
+    static constexpr size_t Combinations = size_t(1) << sizeof...(Rules);
+    static_assert(Combinations <= PlanPrices::MaxCombinations, "too many rules for PlanPrices");
+
+    using Table = std::array<Money, PlanPrices::MaxCombinations>;
+
+    static void prices(Money base, [[maybe_unused]] int operatorRate, Table& table) {
+        const int percents[] = { Rules::percent(operatorRate)..., 0 };
+        for (size_t combination = 0; combination < Combinations; ++combination) {
+            int percent = 0;
+            for (size_t rule = 0; rule < sizeof...(Rules); ++rule) {
+                percent += (combination >> rule & 1) != 0 ? percents[rule] : 0;
+            }
+            table[combination] = base.discounted(std::min(percent, 100));
         }
-        else {
-            std::cout << "Internet connection not allowed. Exceeds bill limit." << std::endl;
+    }
+
+    template <EventKind Kind>
+    static size_t combination([[maybe_unused]] const PricingBatch& batch, [[maybe_unused]] size_t i, [[maybe_unused]] int operatorID) {
+        size_t bits = 0;
+        [[maybe_unused]] size_t rule = 0;
+        ((bits |= static_cast<size_t>(Rules::template applies<Kind>(batch, i, operatorID)) << rule++), ...);
+        return bits;
+    }
+
+    template <EventKind Kind>
+    static void price(const Table& table, const Operator& op, const PricingBatch& batch) {
+        for (size_t i = 0; i < batch.count; ++i) {
+            Money price = table[combination<Kind>(batch, i, op.getID())];
+            Money cost;
+            if constexpr (Kind == EventKind::Network) {
+                cost = price.times(batch.amounts[i]);
+            }
+            else {
+                cost = price * batch.units[i];
+            }
+            batch.costs[i] = batch.debts[i] + cost <= batch.limits[i] ? cost : Money();
+        }
+    }
+};
+
+template <class TalkRules, class MessageRules, class NetworkRules>
+struct TariffPlan {
+    static void price(const Operator& op, EventKind kind, const PricingBatch& batch) {
+        switch (kind) {
+        case EventKind::Talk:
+            TalkRules::template price<EventKind::Talk>(op.getPrices().talk, op, batch);
+            break;
+        case EventKind::Message:
+            MessageRules::template price<EventKind::Message>(op.getPrices().message, op, batch);
+            break;
+        case EventKind::Network:
+            NetworkRules::template price<EventKind::Network>(op.getPrices().network, op, batch);
+            break;
+        }
+    }
+
+    static void prices(const Operator& op, PlanPrices& prices) {
+        TalkRules::prices(op.getTalkingCharge(), op.getDiscountRate(), prices.talk);
+        MessageRules::prices(op.getMessageCost(), op.getDiscountRate(), prices.message);
+        NetworkRules::prices(op.getNetworkCharge(), op.getDiscountRate(), prices.network);
+    }
+};
+
+// The standard plan goes to the SIMD kernels of Operator
+struct StandardPlan {
+    static void price(const Operator& op, EventKind kind, const PricingBatch& batch) {
+        switch (kind) {
+        case EventKind::Talk:
+            op.calculateTalkingCostBatch(batch.units, batch.ages, batch.debts, batch.limits, batch.costs, batch.count);
+            break;
+        case EventKind::Message:
+            op.calculateMessageCostBatch(batch.units, batch.otherOperatorIDs, batch.debts, batch.limits, batch.costs, batch.count);
+            break;
+        case EventKind::Network:
+            op.calculateNetworkCostBatch(batch.amounts, batch.debts, batch.limits, batch.costs, batch.count);
+            break;
+        }
+    }
+
+    // The kernels use the operator's own discounted charges
+    static void prices(const Operator&, PlanPrices&) {}
+};
+
+using OffPeakPlan = TariffPlan<
+    RuleSet<AgeDiscount, OffPeakDiscount<22, 6, 30>>,
+    RuleSet<OnNetDiscount, OffPeakDiscount<22, 6, 30>>,
+    RuleSet<OffPeakDiscount<0, 6, 50>>>;
+
+using VolumePlan = TariffPlan<
+    RuleSet<AgeDiscount, VolumeDiscount<60, 20>>,
+    RuleSet<OnNetDiscount, VolumeDiscount<100, 25>>,
+    RuleSet<VolumeDiscount<1000, 15>>>;
+
+using FlatPlan = TariffPlan<RuleSet<>, RuleSet<>, RuleSet<>>;
+
+// Named tariff plans. An operator refers to its plan by index; index 0 is
+// the standard plan (age discount on talk, on-net discount on messages).
+class TariffRegistry {
+public:
+    using Kernel = void (*)(const Operator&, EventKind, const PricingBatch&);
+    using PriceBuilder = void (*)(const Operator&, PlanPrices&);
+
+    static int find(const std::string& name) {
+        for (size_t i = 0; i < size(); ++i) {
+            if (name == Entries[i].name) {
+                return static_cast<int>(i);
+            }
         }
+        return -1;
+    }
+
+    static Kernel kernel(int plan) {
+        return Entries[plan].kernel;
+    }
+
+    static PriceBuilder priceBuilder(int plan) {
+        return Entries[plan].prices;
+    }
+
+    static const char* name(int plan) {
+        return Entries[plan].name;
+    }
+
+    static size_t size() {
+        return sizeof(Entries) / sizeof(Entries[0]);
+    }
+
+private:
+    struct Entry {
+        const char* name;
+        Kernel kernel;
+        PriceBuilder prices;
+    };
+
+    static constexpr Entry Entries[] = {
+        { "standard", &StandardPlan::price, &StandardPlan::prices },
+        { "offpeak", &OffPeakPlan::price, &OffPeakPlan::prices },
+        { "volume", &VolumePlan::price, &VolumePlan::prices },
+        { "flat", &FlatPlan::price, &FlatPlan::prices },
+    };
+};
+
+// An operator with a plan the registry does not know keeps empty tables;
+// loading rejects such operators before they price anything
+inline void Operator::buildPrices() {
+    if (plan >= 0 && static_cast<size_t>(plan) < TariffRegistry::size()) {
+        TariffRegistry::priceBuilder(plan)(*this, prices);
     }
+}
+
+inline void Operator::priceBatch(EventKind kind, const PricingBatch& batch) const {
+    TariffRegistry::kernel(plan)(*this, kind, batch);
+}
+
+inline Money Operator::priceEvent(EventKind kind, int units, double amount, int age, int otherOperatorID, int64_t time, const Bill& bill) const {
+    Money debt = bill.getCurrentDebt();
+    Money limit = bill.getLimitingAmount();
+    Money cost;
+    PricingBatch batch;
+    batch.count = 1;
+    batch.units = &units;
+    batch.amounts = &amount;
+    batch.ages = &age;
+    batch.otherOperatorIDs = &otherOperatorID;
+    batch.times = &time;
+    batch.debts = &debt;
+    batch.limits = &limit;
+    batch.costs = &cost;
+    priceBatch(kind, batch);
+    return cost;
+}
+
+// What a Customer reports about an action. Customers are referred to by
+// their index in the BillingStore; "count" holds the minutes, the number of
+// messages or the new operator ID.
+enum class BillingEventKind : uint8_t {
+    Talked,
+    TalkRejected,
+    Messaged,
+    MessageRejected,
+    Connected,
+    ConnectionRejected,
+    Paid,
+    PaidMoreThanDebt,
+    PaymentRejected,
+    OperatorChanged,
+    LimitChanged
+};
+
+struct BillingEvent {
+    int64_t time;
+    Money amount;
+    Money debt;
+    int32_t customer;
+    int32_t other;
+    int32_t count;
+    BillingEventKind kind;
+};
+
+// Receives the events of every action. emit is called on the thread that
+// applies the actions and must not block on I/O. A store without a sink is
+// the null sink: reporting then costs a single branch.
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+    virtual void emit(const BillingEvent& event) = 0;
 
-    void payBill(double amount) {
-        if (amount > 0.0) {
-            if (amount > billPtr->getCurrentDebt()) {
-                std::cout << "Warning: Paying more than the current debt. Excess will not be refunded." << std::endl;
+    // Returns once no event emitted so far will read the store any more
+    virtual void flush() {}
+};
+
+class Customer;
+
+// Maps external IDs onto dense indices. IDs that are small compared to the
+// number of entries go into a flat table; the rare far-away ID falls back to
+// a hash map so that one large ID cannot blow up the table.
+class DenseIndex {
+private:
+    std::vector<int32_t> table;
+    std::unordered_map<int, int32_t> sparse;
+
+public:
+    bool insert(int ID, int32_t index) {
+        if (find(ID) >= 0) {
+            return false;
+        }
+        if (ID >= 0 && static_cast<size_t>(ID) < 4 * (static_cast<size_t>(index) + 1) + 1024) {
+            if (static_cast<size_t>(ID) >= table.size()) {
+                grow(std::max(static_cast<size_t>(ID) + 1, table.size() * 2));
             }
-            billPtr->pay(amount);
-            std::cout << name << " paid $" << amount << " of the bill. Remaining debt: $" << billPtr->getCurrentDebt() << std::endl;
+            table[ID] = index;
         }
         else {
-            std::cout << "Invalid payment amount. Payment must be greater than zero." << std::endl;
+            sparse[ID] = index;
         }
+        return true;
     }
 
-    void changeOperator(Operator* newOperator) {
-        operatorPtr = newOperator;
-        std::cout << name << " changed operator to " << newOperator->getID() << std::endl;
+    int32_t find(int ID) const {
+        if (ID >= 0 && static_cast<size_t>(ID) < table.size()) {
+            return table[ID];
+        }
+        auto it = sparse.find(ID);
+        return it != sparse.end() ? it->second : -1;
     }
 
-    void changeBillLimit(double newLimit) {
-        billPtr->changeTheLimit(newLimit);
-        std::cout << name << "'s bill limit changed to $" << newLimit << std::endl;
+private:
+    // Sparse IDs the larger table now covers move into it, so find never
+    // has to look in both
+    void grow(size_t size) {
+        table.resize(size, -1);
+        for (auto it = sparse.begin(); it != sparse.end();) {
+            if (it->first >= 0 && static_cast<size_t>(it->first) < size) {
+                table[it->first] = it->second;
+                it = sparse.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
     }
+};
 
-    int getID() const {
-        return ID;
+// A whole file mapped copy-on-write: writes through the mapping change only
+// this process's pages, never the file.
+class MappedFile {
+private:
+    char* base;
+    size_t length;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+public:
+    MappedFile() : base(nullptr), length(0) {
+#if defined(_WIN32)
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#endif
     }
 
-    const std::string& getName() const {
-        return name;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
     }
 
-    int getAge() const {
-        return age;
+    bool open(const std::string& path) {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        base = mapping != nullptr ? static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0)) : nullptr;
+        length = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        base = address != MAP_FAILED ? static_cast<char*>(address) : nullptr;
+#endif
+        if (base == nullptr) {
+            close();
+            return false;
+        }
+        return true;
     }
 
-    Operator* getOperator() const {
-        return operatorPtr;
+    void close() {
+#if defined(_WIN32)
+        if (base != nullptr) {
+            UnmapViewOfFile(base);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    char* data() const {
+        return base;
     }
 
-    Bill* getBill() const {
-        return billPtr;
+    size_t size() const {
+        return length;
     }
 };
 
-// Function to read input from a JSON file
-void readInputFromJSON(const std::string& filename, std::vector<Customer>& customers, std::vector<Operator>& operators, std::vector<Bill>& bills) {
-    std::ifstream input(filename);
-    if (!input.is_open()) {
-        std::cerr << "Error: Unable to open input file." << std::endl;
-        return;
+// One column of the BillingStore. It either owns its elements or uses
+// elements that live in a mapped snapshot; the first append to a mapped
+// column copies it into memory it owns.
+template <class T>
+class Column {
+private:
+    std::vector<T> owned;
+    T* items;
+    size_t count;
+
+    void own() {
+        if (items != owned.data() || owned.size() != count) {
+            std::vector<T> copy(items, items + count);
+            owned.swap(copy);
+            items = owned.data();
+        }
     }
 
-    json inputData;
-    input >> inputData;
+public:
+    Column() : items(nullptr), count(0) {}
 
-    
-}
+    Column(const Column&) = delete;
+    Column& operator=(const Column&) = delete;
 
-// Function to write output to a JSON file
-void writeOutputToJSON(const std::string& filename, const std::vector<Customer>& customers) {
-    json outputData;
+    Column(Column&& other) noexcept : owned(std::move(other.owned)), items(other.items), count(other.count) {
+        other.items = nullptr;
+        other.count = 0;
+    }
 
-    
+    Column& operator=(Column&& other) noexcept {
+        owned = std::move(other.owned);
+        items = other.items;
+        count = other.count;
+        other.items = nullptr;
+        other.count = 0;
+        return *this;
+    }
 
-    std::ofstream output(filename);
-    output << std::setw(4) << outputData; // Pretty print JSON
-}
+    void push_back(const T& value) {
+        own();
+        owned.push_back(value);
+        items = owned.data();
+        ++count;
+    }
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <input.json>" << std::endl;
-        return 1;
+    void append(const T* values, size_t n) {
+        own();
+        owned.insert(owned.end(), values, values + n);
+        items = owned.data();
+        count += n;
     }
 
-    const std::string inputFilename = "input.json";
-    const std::string outputFilename = "output.json";
+    void reserve(size_t n) {
+        own();
+        owned.reserve(n);
+        items = owned.data();
+    }
 
-    std::vector<Customer> customers;
-    std::vector<Operator> operators;
-    std::vector<Bill> bills;
+    // Uses n elements at mapped, which must outlive the column
+    void attach(T* mapped, size_t n) {
+        owned = std::vector<T>();
+        items = mapped;
+        count = n;
+    }
+
+    void detach() {
+        own();
+    }
+
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+};
+
+// What a usage rollup counts. Talk and Message are the calls and messages a
+// customer started; the Incoming kinds are the ones charged to the receiver.
+enum class UsageKind : uint8_t {
+    Talk,
+    Message,
+    Network,
+    IncomingTalk,
+    IncomingMessage,
+    Payment
+};
+
+const size_t UsageKindCount = 6;
+
+// Number of actions, units (minutes, messages, data) and amount charged or
+// paid, by kind. Units are kept in millionths like Money, so the totals do
+// not depend on the order in which actions were added.
+struct UsageTotals {
+    uint64_t count[UsageKindCount] = {};
+    int64_t microUnits[UsageKindCount] = {};
+    Money amount[UsageKindCount];
+
+    void add(UsageKind kind, double actionUnits, Money actionAmount) {
+        size_t i = static_cast<size_t>(kind);
+        ++count[i];
+        microUnits[i] += Money::roundToInteger(actionUnits * Money::MicrosPerUnit);
+        amount[i] += actionAmount;
+    }
+
+    double getUnits(UsageKind kind) const {
+        return static_cast<double>(microUnits[static_cast<size_t>(kind)]) / Money::MicrosPerUnit;
+    }
+
+    void merge(const UsageTotals& other) {
+        for (size_t i = 0; i < UsageKindCount; ++i) {
+            count[i] += other.count[i];
+            microUnits[i] += other.microUnits[i];
+            amount[i] += other.amount[i];
+        }
+    }
+};
+
+// Usage per customer and per operator, in total and per time bucket of
+// bucketWidth seconds, kept up to date as actions are applied so that a
+// query is a single lookup. Customer totals are a dense column; everything
+// else is shared between customers and is updated through addShared, which
+// the ShardedExecutor does on a partial rollup per shard and merges after
+// each batch. A rollup with a bucket width of zero records nothing. Only
+// the latest RetainedBuckets buckets are kept: older ones are dropped when
+// the latest bucket moves on, and actions that fall before them count in
+// the totals only. The rollup is not part of a Snapshot.
+class UsageRollup {
+public:
+    static constexpr int64_t RetainedBuckets = 8;
+
+private:
+    struct BucketKey {
+        int32_t index;
+        int64_t bucket;
+
+        bool operator==(const BucketKey& other) const {
+            return index == other.index && bucket == other.bucket;
+        }
+    };
+
+    struct BucketKeyHash {
+        size_t operator()(const BucketKey& key) const {
+            return std::hash<uint64_t>()(static_cast<uint64_t>(key.bucket) * 1000003 + static_cast<uint32_t>(key.index));
+        }
+    };
+
+    using Buckets = std::unordered_map<BucketKey, UsageTotals, BucketKeyHash>;
+
+    int64_t bucketWidth;
+    int64_t latestTime;
+    int64_t firstRetained; // Oldest bucket still kept
+    std::vector<UsageTotals> customers;
+    std::vector<UsageTotals> operators;
+    Buckets customerBuckets;
+    Buckets operatorBuckets;
+
+    static UsageTotals find(const Buckets& buckets, BucketKey key) {
+        auto it = buckets.find(key);
+        return it != buckets.end() ? it->second : UsageTotals();
+    }
+
+    static void expire(Buckets& buckets, int64_t oldest) {
+        for (auto it = buckets.begin(); it != buckets.end();) {
+            it = it->first.bucket < oldest ? buckets.erase(it) : std::next(it);
+        }
+    }
+
+    // Advances the retained window to end at the bucket of time
+    void advance(int64_t time) {
+        latestTime = std::max(latestTime, time);
+        int64_t oldest = bucketOf(latestTime) - RetainedBuckets + 1;
+        if (oldest > firstRetained) {
+            firstRetained = oldest;
+            expire(customerBuckets, oldest);
+            expire(operatorBuckets, oldest);
+        }
+    }
+
+public:
+    UsageRollup() : bucketWidth(0), latestTime(0), firstRetained(INT64_MIN) {}
+
+    void enable(int64_t width) {
+        bucketWidth = width;
+    }
+
+    bool isEnabled() const {
+        return bucketWidth > 0;
+    }
+
+    int64_t getBucketWidth() const {
+        return bucketWidth;
+    }
+
+    // Must cover every customer and operator before actions are recorded
+    void resize(size_t customerCount, size_t operatorCount) {
+        customers.resize(customerCount);
+        operators.resize(operatorCount);
+    }
+
+    // Time of the latest action recorded
+    int64_t getLatestTime() const {
+        return latestTime;
+    }
+
+    int64_t bucketOf(int64_t time) const {
+        return time / bucketWidth;
+    }
+
+    void addCustomer(int32_t customer, UsageKind kind, double units, Money amount) {
+        customers[customer].add(kind, units, amount);
+    }
 
-    readInputFromJSON(inputFilename, customers, operators, bills);
+    void addShared(int32_t customer, int32_t operatorIndex, UsageKind kind, double units, Money amount, int64_t time) {
+        int64_t bucket = bucketOf(time);
+        advance(time);
+        bool retained = bucket >= firstRetained;
+        if (retained) {
+            customerBuckets[{customer, bucket}].add(kind, units, amount);
+        }
+        if (operatorIndex >= 0) {
+            operators[operatorIndex].add(kind, units, amount);
+            if (retained) {
+                operatorBuckets[{operatorIndex, bucket}].add(kind, units, amount);
+            }
+        }
+    }
 
-    // Perform actions based on the given input (as in the previous code)
+    void record(int32_t customer, int32_t operatorIndex, UsageKind kind, double units, Money amount, int64_t time) {
+        if (isEnabled()) {
+            addCustomer(customer, kind, units, amount);
+            addShared(customer, operatorIndex, kind, units, amount, time);
+        }
+    }
 
-    writeOutputToJSON(outputFilename, customers);
+    // Moves the shared part of a partial rollup into this one
+    void merge(UsageRollup& partial) {
+        advance(partial.latestTime);
+        for (size_t i = 0; i < partial.operators.size(); ++i) {
+            operators[i].merge(partial.operators[i]);
+            partial.operators[i] = UsageTotals();
+        }
+        for (const auto& entry : partial.customerBuckets) {
+            if (entry.first.bucket >= firstRetained) {
+                customerBuckets[entry.first].merge(entry.second);
+            }
+        }
+        for (const auto& entry : partial.operatorBuckets) {
+            if (entry.first.bucket >= firstRetained) {
+                operatorBuckets[entry.first].merge(entry.second);
+            }
+        }
+        partial.customerBuckets.clear();
+        partial.operatorBuckets.clear();
+    }
+
+    const UsageTotals& customer(size_t index) const {
+        return customers[index];
+    }
+
+    const UsageTotals& getOperator(size_t index) const {
+        return operators[index];
+    }
+
+    UsageTotals customerBucket(int32_t customer, int64_t bucket) const {
+        return find(customerBuckets, {customer, bucket});
+    }
+
+    UsageTotals operatorBucket(int32_t operatorIndex, int64_t bucket) const {
+        return find(operatorBuckets, {operatorIndex, bucket});
+    }
+};
+
+// Struct-of-arrays storage for all customers and their bills. Each column is
+// one contiguous vector indexed by the dense customer index, so applying an
+// action touches a few array slots instead of chasing Customer -> Bill and
+// Customer -> Operator pointers, and no customer owns a heap allocation.
+// Customer and Bill are views (store + index) and stay valid when the
+// columns grow. After Snapshot::load the columns live in the mapped snapshot.
+class BillingStore {
+private:
+    Column<int32_t> IDs;
+    Column<int32_t> ages;
+    Column<int32_t> operatorIndices;
+    Column<Money> limits;
+    Column<Money> debts;
+    Column<uint32_t> nameOffsets;
+    Column<char> namePool;
+    std::vector<Operator> operators;
+    DenseIndex customerIDs;
+    DenseIndex operatorIDs;
+    std::shared_ptr<MappedFile> mapping;
+    EventSink* events = nullptr;
+    UsageRollup usage;
+
+    friend class Bill;
+    friend class Customer;
+    friend class Snapshot;
+
+public:
+    BillingStore() {
+        nameOffsets.push_back(0);
+    }
+
+    BillingStore(BillingStore&&) = default;
+    BillingStore& operator=(BillingStore&&) = default;
+
+    // Copies columns that live in a mapped snapshot into owned memory
+    void detach() {
+        IDs.detach();
+        ages.detach();
+        operatorIndices.detach();
+        limits.detach();
+        debts.detach();
+        nameOffsets.detach();
+        namePool.detach();
+        mapping.reset();
+    }
+
+    void reserveCustomers(size_t count) {
+        IDs.reserve(count);
+        ages.reserve(count);
+        operatorIndices.reserve(count);
+        limits.reserve(count);
+        debts.reserve(count);
+        nameOffsets.reserve(count + 1);
+    }
+
+    // Returns the dense index of the new operator, or -1 if the ID is taken
+    int32_t addOperator(const Operator& op) {
+        int32_t index = static_cast<int32_t>(operators.size());
+        if (!operatorIDs.insert(op.getID(), index)) {
+            return -1;
+        }
+        operators.push_back(op);
+        return index;
+    }
+
+    // Returns the dense index of the new customer, or -1 if the ID is taken
+    int32_t addCustomer(int ID, const std::string& name, int age, int32_t operatorIndex, Money limit) {
+        int32_t index = static_cast<int32_t>(IDs.size());
+        if (!customerIDs.insert(ID, index)) {
+            return -1;
+        }
+        IDs.push_back(ID);
+        ages.push_back(age);
+        operatorIndices.push_back(operatorIndex);
+        limits.push_back(limit);
+        debts.push_back(Money());
+        namePool.append(name.data(), name.size());
+        nameOffsets.push_back(static_cast<uint32_t>(namePool.size()));
+        return index;
+    }
+
+    int32_t findCustomer(int ID) const {
+        return customerIDs.find(ID);
+    }
+
+    int32_t findOperator(int ID) const {
+        return operatorIDs.find(ID);
+    }
+
+    size_t customerCount() const {
+        return IDs.size();
+    }
+
+    size_t operatorCount() const {
+        return operators.size();
+    }
+
+    Customer customer(size_t index);
+    Bill bill(size_t index) {
+        return Bill(this, index);
+    }
+
+    Operator& getOperator(size_t index) {
+        return operators[index];
+    }
+
+    const Operator& getOperator(size_t index) const {
+        return operators[index];
+    }
+
+    void setOperatorIndex(size_t index, int32_t operatorIndex) {
+        operatorIndices[index] = operatorIndex;
+    }
+
+    int getCustomerID(size_t index) const { return IDs[index]; }
+    int getAge(size_t index) const { return ages[index]; }
+    int32_t getOperatorIndex(size_t index) const { return operatorIndices[index]; }
+    Money getLimit(size_t index) const { return limits[index]; }
+    Money getDebt(size_t index) const { return debts[index]; }
+
+    UsageRollup& getUsage() {
+        return usage;
+    }
+
+    const UsageRollup& getUsage() const {
+        return usage;
+    }
+
+    // Null reports nothing
+    void setEventSink(EventSink* sink) {
+        events = sink;
+    }
+
+    EventSink* getEventSink() const {
+        return events;
+    }
+
+    std::string_view getName(size_t index) const {
+        return std::string_view(namePool.data() + nameOffsets[index], nameOffsets[index + 1] - nameOffsets[index]);
+    }
+};
+
+inline bool Bill::check(Money amount) const {
+    return (store->debts[index] + amount) <= store->limits[index];
+}
+
+inline void Bill::add(Money amount) {
+    store->debts[index] += amount;
+}
+
+inline void Bill::pay(Money amount) {
+    Money& currentDebt = store->debts[index];
+    if (amount > currentDebt) {
+        currentDebt = Money();
+    }
+    else {
+        currentDebt -= amount;
+    }
+}
+
+inline void Bill::changeTheLimit(Money amount) {
+    store->limits[index] = amount;
+}
+
+inline Money Bill::getLimitingAmount() const {
+    return store->limits[index];
+}
+
+inline Money Bill::getCurrentDebt() const {
+    return store->debts[index];
+}
+
+// A view of one customer inside the BillingStore
+class Customer {
+private:
+    BillingStore* store;
+    size_t index;
+
+public:
+    Customer(BillingStore* store, size_t index) : store(store), index(index) {}
+
+    void talk(int minute, Customer& other, int64_t time = 0) {
+        talkPriced(minute, other, getOperator()->calculateTalkingCost(minute, getBill(), getAge(), time), time);
+    }
+
+    void message(int quantity, Customer& other, int64_t time = 0) {
+        messagePriced(quantity, other, getOperator()->calculateMessageCost(quantity, *other.getOperator(), getBill(), getAge(), time), time);
+    }
+
+    void connection(double amount, int64_t time = 0) {
+        connectionPriced(amount, getOperator()->calculateNetworkCost(amount, getBill(), time), time);
+    }
+
+    // talk, message and connection with the price already worked out by the
+    // operator, e.g. by an ActionPricer; the bill limit is checked here
+    void talkPriced(int minute, Customer& other, Money price, int64_t time = 0) {
+        Bill bill = getBill();
+        Money cost = bill.check(price) ? price : Money();
+        if (cost > Money()) {
+            bill.add(cost);
+            other.getBill().add(cost);
+            recordUsage(UsageKind::Talk, minute, cost, time);
+            other.recordUsage(UsageKind::IncomingTalk, minute, cost, time);
+            report(BillingEventKind::Talked, time, cost, Money(), static_cast<int32_t>(other.index), minute);
+        }
+        else {
+            report(BillingEventKind::TalkRejected, time);
+        }
+    }
+
+    void messagePriced(int quantity, Customer& other, Money price, int64_t time = 0) {
+        Bill bill = getBill();
+        Money cost = bill.check(price) ? price : Money();
+        if (cost > Money()) {
+            bill.add(cost);
+            other.getBill().add(cost);
+            recordUsage(UsageKind::Message, quantity, cost, time);
+            other.recordUsage(UsageKind::IncomingMessage, quantity, cost, time);
+            report(BillingEventKind::Messaged, time, cost, Money(), static_cast<int32_t>(other.index), quantity);
+        }
+        else {
+            report(BillingEventKind::MessageRejected, time);
+        }
+    }
+
+    void connectionPriced(double amount, Money price, int64_t time = 0) {
+        Bill bill = getBill();
+        Money cost = bill.check(price) ? price : Money();
+        if (cost > Money()) {
+            bill.add(cost);
+            recordUsage(UsageKind::Network, amount, cost, time);
+            report(BillingEventKind::Connected, time, cost);
+        }
+        else {
+            report(BillingEventKind::ConnectionRejected, time);
+        }
+    }
+
+    void payBill(Money amount, int64_t time = 0) {
+        if (amount > Money()) {
+            Bill bill = getBill();
+            if (amount > bill.getCurrentDebt()) {
+                report(BillingEventKind::PaidMoreThanDebt, time, amount);
+            }
+            bill.pay(amount);
+            recordUsage(UsageKind::Payment, 0, amount, time);
+            report(BillingEventKind::Paid, time, amount, bill.getCurrentDebt());
+        }
+        else {
+            report(BillingEventKind::PaymentRejected, time, amount);
+        }
+    }
+
+    void changeOperator(Operator* newOperator, int64_t time = 0) {
+        store->setOperatorIndex(index, store->findOperator(newOperator->getID()));
+        report(BillingEventKind::OperatorChanged, time, Money(), Money(), -1, newOperator->getID());
+    }
+
+    void changeBillLimit(Money newLimit, int64_t time = 0) {
+        getBill().changeTheLimit(newLimit);
+        report(BillingEventKind::LimitChanged, time, newLimit);
+    }
+
+    int getID() const {
+        return store->IDs[index];
+    }
+
+    std::string_view getName() const {
+        return store->getName(index);
+    }
+
+    int getAge() const {
+        return store->ages[index];
+    }
+
+    // Null for a customer whose operator was not found in the input
+    Operator* getOperator() const {
+        int32_t operatorIndex = store->operatorIndices[index];
+        return operatorIndex >= 0 ? &store->operators[operatorIndex] : nullptr;
+    }
+
+    Bill getBill() const {
+        return Bill(store, index);
+    }
+
+private:
+    void recordUsage(UsageKind kind, double units, Money amount, int64_t time) const {
+        store->usage.record(static_cast<int32_t>(index), store->operatorIndices[index], kind, units, amount, time);
+    }
+
+    void report(BillingEventKind kind, int64_t time, Money amount = Money(), Money debt = Money(), int32_t other = -1, int32_t count = 0) const {
+        if (store->events != nullptr) {
+            store->events->emit(BillingEvent{ time, amount, debt, static_cast<int32_t>(index), other, count, kind });
+        }
+    }
+};
+
+inline Customer BillingStore::customer(size_t index) {
+    return Customer(this, index);
+}
+
+enum class EventFormat {
+    Text,
+    JsonLines,
+    Binary
+};
+
+// Event sink that never blocks the billing thread on I/O. emit copies the
+// event into a single-producer ring buffer; a background thread formats the
+// events as text, JSON lines or fixed-size binary records and writes them in
+// large chunks. Only a full ring makes emit wait for the writer. Actions run
+// on a ShardedExecutor bypass Customer and report nothing, so a sink is only
+// installed for sequential runs.
+class AsyncEventSink : public EventSink {
+public:
+    static constexpr char Magic[8] = { 'B', 'I', 'L', 'L', 'E', 'V', 'T', '1' };
+
+    // One binary event; customers are identified by their IDs
+    struct Record {
+        int64_t time;
+        int64_t amount;
+        int64_t debt;
+        int32_t customerID;
+        int32_t otherCustomerID;
+        int32_t count;
+        uint8_t kind;
+        uint8_t reserved[3];
+    };
+
+    AsyncEventSink(const BillingStore& store, FILE* output, EventFormat format, size_t capacity = size_t(1) << 16)
+        : store(store), output(output), format(format), slots(roundUpToPowerOfTwo(capacity)), mask(slots.size() - 1),
+        head(0), tail(0), written(0), stopping(false) {
+        if (format == EventFormat::Binary) {
+            std::fwrite(Magic, sizeof(Magic), 1, output);
+        }
+        writer = std::thread(&AsyncEventSink::run, this);
+    }
+
+    AsyncEventSink(const AsyncEventSink&) = delete;
+    AsyncEventSink& operator=(const AsyncEventSink&) = delete;
+
+    ~AsyncEventSink() override {
+        close();
+    }
+
+    void emit(const BillingEvent& event) override {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        while (position - tail.load(std::memory_order_acquire) > mask) {
+            std::this_thread::yield();
+        }
+        slots[position & mask] = event;
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    // Waits until every event emitted so far has been written out
+    void flush() override {
+        uint64_t target = head.load(std::memory_order_relaxed);
+        while (written.load(std::memory_order_acquire) < target) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Writes the remaining events and stops the writer
+    void close() {
+        if (writer.joinable()) {
+            stopping.store(true, std::memory_order_release);
+            writer.join();
+        }
+    }
+
+private:
+    static const size_t ChunkSize = 64 * 1024;
+
+    const BillingStore& store;
+    FILE* output;
+    EventFormat format;
+    std::vector<BillingEvent> slots;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> written;
+    std::atomic<bool> stopping;
+    std::thread writer;
+    std::string buffer;
+
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void run() {
+        buffer.reserve(ChunkSize * 2);
+        for (;;) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            uint64_t end = head.load(std::memory_order_acquire);
+            uint64_t position = tail.load(std::memory_order_relaxed);
+            if (position == end) {
+                writeBuffer();
+                written.store(end, std::memory_order_release);
+                if (stop) {
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            for (; position != end; ++position) {
+                format == EventFormat::Binary ? appendBinary(slots[position & mask]) : format == EventFormat::JsonLines
+                    ? appendJson(slots[position & mask]) : appendText(slots[position & mask]);
+                if (buffer.size() >= ChunkSize) {
+                    tail.store(position + 1, std::memory_order_release);
+                    std::fwrite(buffer.data(), 1, buffer.size(), output);
+                    buffer.clear();
+                }
+            }
+            tail.store(end, std::memory_order_release);
+        }
+    }
+
+    void writeBuffer() {
+        if (!buffer.empty()) {
+            std::fwrite(buffer.data(), 1, buffer.size(), output);
+            buffer.clear();
+        }
+        std::fflush(output);
+    }
+
+    void appendName(int32_t customer) {
+        std::string_view name = store.getName(static_cast<size_t>(customer));
+        buffer.append(name.data(), name.size());
+    }
+
+    // The messages Customer used to print
+    void appendText(const BillingEvent& event) {
+        switch (event.kind) {
+        case BillingEventKind::Talked:
+            appendName(event.customer);
+            buffer += " talked to ";
+            appendName(event.other);
+            buffer += " for " + std::to_string(event.count) + " minutes. Cost: $";
+            appendMoney(buffer, event.amount);
+            break;
+        case BillingEventKind::TalkRejected:
+            buffer += "Talking not allowed. Exceeds bill limit.";
+            break;
+        case BillingEventKind::Messaged:
+            appendName(event.customer);
+            buffer += " sent " + std::to_string(event.count) + " messages to ";
+            appendName(event.other);
+            buffer += ". Cost: $";
+            appendMoney(buffer, event.amount);
+            break;
+        case BillingEventKind::MessageRejected:
+            buffer += "Messaging not allowed. Exceeds bill limit.";
+            break;
+        case BillingEventKind::Connected:
+            appendName(event.customer);
+            buffer += " connected to the internet. Cost: $";
+            appendMoney(buffer, event.amount);
+            break;
+        case BillingEventKind::ConnectionRejected:
+            buffer += "Internet connection not allowed. Exceeds bill limit.";
+            break;
+        case BillingEventKind::Paid:
+            appendName(event.customer);
+            buffer += " paid $";
+            appendMoney(buffer, event.amount);
+            buffer += " of the bill. Remaining debt: $";
+            appendMoney(buffer, event.debt);
+            break;
+        case BillingEventKind::PaidMoreThanDebt:
+            buffer += "Warning: Paying more than the current debt. Excess will not be refunded.";
+            break;
+        case BillingEventKind::PaymentRejected:
+            buffer += "Invalid payment amount. Payment must be greater than zero.";
+            break;
+        case BillingEventKind::OperatorChanged:
+            appendName(event.customer);
+            buffer += " changed operator to " + std::to_string(event.count);
+            break;
+        case BillingEventKind::LimitChanged:
+            appendName(event.customer);
+            buffer += "'s bill limit changed to $";
+            appendMoney(buffer, event.amount);
+            break;
+        }
+        buffer += '\n';
+    }
+
+    void appendJson(const BillingEvent& event) {
+        static const char* const Names[] = { "talk", "talkRejected", "message", "messageRejected", "connect",
+            "connectRejected", "pay", "payExceedsDebt", "payRejected", "changeOperator", "changeBillLimit" };
+        buffer += "{\"event\":\"";
+        buffer += Names[static_cast<size_t>(event.kind)];
+        buffer += "\",\"time\":" + std::to_string(event.time);
+        buffer += ",\"customerID\":" + std::to_string(store.getCustomerID(event.customer));
+        if (event.other >= 0) {
+            buffer += ",\"otherCustomerID\":" + std::to_string(store.getCustomerID(event.other));
+        }
+        if (event.count != 0) {
+            buffer += ",\"count\":" + std::to_string(event.count);
+        }
+        buffer += ",\"amount\":";
+        appendMoney(buffer, event.amount);
+        if (event.kind == BillingEventKind::Paid) {
+            buffer += ",\"debt\":";
+            appendMoney(buffer, event.debt);
+        }
+        buffer += "}\n";
+    }
+
+    void appendBinary(const BillingEvent& event) {
+        Record record = {};
+        record.time = event.time;
+        record.amount = event.amount.getMicros();
+        record.debt = event.debt.getMicros();
+        record.customerID = store.getCustomerID(event.customer);
+        record.otherCustomerID = event.other >= 0 ? store.getCustomerID(event.other) : -1;
+        record.count = event.count;
+        record.kind = static_cast<uint8_t>(event.kind);
+        buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+};
+
+// Versioned binary image of a BillingStore. The header is followed by the
+// store columns, each at a 64-byte aligned offset listed in the header, in
+// the byte order of the machine that wrote it. Loading maps the file
+// copy-on-write and points the columns straight into the mapping, so a
+// restart costs one pass to rebuild the ID indices rather than a replay.
+class Snapshot {
+public:
+    static const uint32_t Version = 1;
+
+    // Writes to path + ".tmp", syncs it and renames it over path, so a crash
+    // leaves either the previous or the new snapshot. actionRecords is the
+    // number of "actions" elements consumed so far.
+    static bool write(BillingStore& store, uint64_t actionRecords, const std::string& path) {
+#if defined(_WIN32)
+        // A mapped file cannot be replaced on Windows. Detaching frees the
+        // mapped name pool, which queued events still read when formatted.
+        if (store.mapping) {
+            if (store.events != nullptr) {
+                store.events->flush();
+            }
+            store.detach();
+        }
+#endif
+        Header header = {};
+        std::memcpy(header.magic, Magic, sizeof(header.magic));
+        header.version = Version;
+        header.byteOrder = ByteOrder;
+        header.customerCount = store.customerCount();
+        header.operatorCount = store.operatorCount();
+        header.namePoolSize = store.namePool.size();
+        header.actionRecords = actionRecords;
+
+        std::vector<OperatorRecord> operators;
+        for (const Operator& op : store.operators) {
+            operators.push_back({ op.getID(), op.getDiscountRate(), op.getPlan(), 0,
+                op.getTalkingCharge().getMicros(), op.getMessageCost().getMicros(), op.getNetworkCharge().getMicros() });
+        }
+
+        const void* columns[ColumnCount] = { store.IDs.data(), store.ages.data(), store.operatorIndices.data(),
+            store.limits.data(), store.debts.data(), store.nameOffsets.data(), store.namePool.data(), operators.data() };
+        size_t sizes[ColumnCount];
+        columnSizes(header, sizes);
+        uint64_t offset = align(sizeof(Header));
+        for (int column = 0; column < ColumnCount; ++column) {
+            header.offsets[column] = offset;
+            offset = align(offset + sizes[column]);
+        }
+
+        const std::string temporary = path + ".tmp";
+        FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "Error: Unable to write snapshot " << temporary << "." << std::endl;
+            return false;
+        }
+        static const char padding[64] = {};
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        uint64_t position = sizeof(header);
+        for (int column = 0; column < ColumnCount && ok; ++column) {
+            ok = std::fwrite(padding, 1, header.offsets[column] - position, file) == header.offsets[column] - position
+                && (sizes[column] == 0 || std::fwrite(columns[column], 1, sizes[column], file) == sizes[column]);
+            position = header.offsets[column] + sizes[column];
+        }
+        ok = ok && std::fflush(file) == 0;
+#if defined(_WIN32)
+        ok = ok && _commit(_fileno(file)) == 0;
+#else
+        ok = ok && fsync(fileno(file)) == 0;
+#endif
+        ok = std::fclose(file) == 0 && ok;
+#if defined(_WIN32)
+        ok = ok && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        ok = ok && std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+        if (!ok) {
+            std::cerr << "Error: Unable to write snapshot " << path << "." << std::endl;
+            std::remove(temporary.c_str());
+        }
+        return ok;
+    }
+
+    // Replaces the content of an empty store with the snapshot at path
+    static bool load(BillingStore& store, const std::string& path, uint64_t& actionRecords) {
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        if (!file->open(path)) {
+            return false;
+        }
+        Header header;
+        if (file->size() < sizeof(Header)) {
+            return invalid(path, "truncated header");
+        }
+        std::memcpy(&header, file->data(), sizeof(Header));
+        if (std::memcmp(header.magic, Magic, sizeof(header.magic)) != 0 || header.byteOrder != ByteOrder) {
+            return invalid(path, "not a snapshot of this machine");
+        }
+        if (header.version != Version) {
+            return invalid(path, "unsupported version " + std::to_string(header.version));
+        }
+        if (header.customerCount > INT32_MAX || header.operatorCount > INT32_MAX) {
+            return invalid(path, "too many entries");
+        }
+        size_t sizes[ColumnCount];
+        columnSizes(header, sizes);
+        for (int column = 0; column < ColumnCount; ++column) {
+            if (header.offsets[column] % 64 != 0 || header.offsets[column] > file->size()
+                || sizes[column] > file->size() - header.offsets[column]) {
+                return invalid(path, "column out of range");
+            }
+        }
+
+        char* base = file->data();
+        const OperatorRecord* operators = reinterpret_cast<const OperatorRecord*>(base + header.offsets[OperatorsColumn]);
+        const uint32_t* nameOffsets = reinterpret_cast<const uint32_t*>(base + header.offsets[NameOffsetsColumn]);
+        const int32_t* operatorIndices = reinterpret_cast<const int32_t*>(base + header.offsets[OperatorIndicesColumn]);
+        for (uint64_t i = 0; i < header.customerCount; ++i) {
+            if (nameOffsets[i] > nameOffsets[i + 1] || nameOffsets[i + 1] > header.namePoolSize
+                || operatorIndices[i] < -1 || operatorIndices[i] >= static_cast<int64_t>(header.operatorCount)) {
+                return invalid(path, "corrupt customer " + std::to_string(i));
+            }
+        }
+        for (uint64_t i = 0; i < header.operatorCount; ++i) {
+            if (operators[i].plan < 0 || static_cast<size_t>(operators[i].plan) >= TariffRegistry::size()) {
+                return invalid(path, "unknown tariff plan");
+            }
+        }
+
+        store = BillingStore();
+        for (uint64_t i = 0; i < header.operatorCount; ++i) {
+            const OperatorRecord& op = operators[i];
+            store.addOperator(Operator(op.ID, Money::fromMicros(op.talkingCharge), Money::fromMicros(op.messageCost),
+                Money::fromMicros(op.networkCharge), op.discountRate, op.plan));
+        }
+        size_t count = static_cast<size_t>(header.customerCount);
+        store.IDs.attach(reinterpret_cast<int32_t*>(base + header.offsets[IDsColumn]), count);
+        store.ages.attach(reinterpret_cast<int32_t*>(base + header.offsets[AgesColumn]), count);
+        store.operatorIndices.attach(reinterpret_cast<int32_t*>(base + header.offsets[OperatorIndicesColumn]), count);
+        store.limits.attach(reinterpret_cast<Money*>(base + header.offsets[LimitsColumn]), count);
+        store.debts.attach(reinterpret_cast<Money*>(base + header.offsets[DebtsColumn]), count);
+        store.nameOffsets.attach(reinterpret_cast<uint32_t*>(base + header.offsets[NameOffsetsColumn]), count + 1);
+        store.namePool.attach(base + header.offsets[NamePoolColumn], static_cast<size_t>(header.namePoolSize));
+        for (size_t i = 0; i < count; ++i) {
+            if (!store.customerIDs.insert(store.IDs[i], static_cast<int32_t>(i))) {
+                store = BillingStore();
+                return invalid(path, "duplicate customer ID");
+            }
+        }
+        store.mapping = file;
+        actionRecords = header.actionRecords;
+        return true;
+    }
+
+private:
+    enum ColumnIndex {
+        IDsColumn,
+        AgesColumn,
+        OperatorIndicesColumn,
+        LimitsColumn,
+        DebtsColumn,
+        NameOffsetsColumn,
+        NamePoolColumn,
+        OperatorsColumn,
+        ColumnCount
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t customerCount;
+        uint64_t operatorCount;
+        uint64_t namePoolSize;
+        uint64_t actionRecords;
+        uint64_t offsets[ColumnCount];
+    };
+
+    struct OperatorRecord {
+        int32_t ID;
+        int32_t discountRate;
+        int32_t plan;
+        int32_t reserved;
+        int64_t talkingCharge;
+        int64_t messageCost;
+        int64_t networkCharge;
+    };
+
+    static constexpr char Magic[8] = { 'B', 'I', 'L', 'L', 'S', 'N', 'A', 'P' };
+    static const uint32_t ByteOrder = 0x01020304;
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + 63) & ~uint64_t(63);
+    }
+
+    static void columnSizes(const Header& header, size_t* sizes) {
+        size_t customers = static_cast<size_t>(header.customerCount);
+        sizes[IDsColumn] = customers * sizeof(int32_t);
+        sizes[AgesColumn] = customers * sizeof(int32_t);
+        sizes[OperatorIndicesColumn] = customers * sizeof(int32_t);
+        sizes[LimitsColumn] = customers * sizeof(Money);
+        sizes[DebtsColumn] = customers * sizeof(Money);
+        sizes[NameOffsetsColumn] = (customers + 1) * sizeof(uint32_t);
+        sizes[NamePoolColumn] = static_cast<size_t>(header.namePoolSize);
+        sizes[OperatorsColumn] = static_cast<size_t>(header.operatorCount) * sizeof(OperatorRecord);
+    }
+
+    static bool invalid(const std::string& path, const std::string& reason) {
+        std::cerr << "Error: Snapshot " << path << " is unusable: " << reason << "." << std::endl;
+        return false;
+    }
+};
+
+// Thread-safe bill for real-time authorization from many threads. Amounts
+// are Money, kept as integer micro-units in atomics. The limit check works
+// on a single word, headroom (limit - debt - open reservations), so a
+// check-and-add is one CAS loop and two concurrent charges can never both
+// pass and overshoot the limit. The debt is kept in a second word; a reader
+// may see it lag behind headroom for a moment, which only ever makes
+// authorization more conservative. The input pipeline does not use it:
+// actions are applied by one thread per customer there, so AtomicBill and
+// AuthorizationTable are a standalone mode for a front end that authorizes
+// charges concurrently.
+class AtomicBill {
+public:
+    // Amount held on a bill by reserve() until it is committed or cancelled
+    class Reservation {
+    private:
+        Money amount;
+        friend class AtomicBill;
+
+    public:
+        bool isValid() const {
+            return amount > Money();
+        }
+
+        Money getAmount() const {
+            return amount;
+        }
+    };
+
+    explicit AtomicBill(Money limit = Money(), Money debt = Money())
+        : limit(limit.getMicros()), debt(debt.getMicros()), headroom((limit - debt).getMicros()) {}
+
+    // Adds the charge only if it fits under the limit. A negative amount is
+    // refused; it would raise the headroom past the limit.
+    bool tryAdd(Money amount) {
+        if (amount < Money() || !take(amount.getMicros())) {
+            return false;
+        }
+        debt.fetch_add(amount.getMicros(), std::memory_order_relaxed);
+        return true;
+    }
+
+    // Adds the charge unconditionally, like the receiving side of a talk
+    void add(Money amount) {
+        headroom.fetch_sub(amount.getMicros(), std::memory_order_acq_rel);
+        debt.fetch_add(amount.getMicros(), std::memory_order_relaxed);
+    }
+
+    // Holds the amount for a long call. Returns an invalid reservation if it
+    // does not fit under the limit.
+    Reservation reserve(Money amount) {
+        Reservation reservation;
+        if (amount > Money() && take(amount.getMicros())) {
+            reservation.amount = amount;
+        }
+        return reservation;
+    }
+
+    // Turns the reservation into debt. Usage above the reserved amount is not
+    // authorized and is cut to it; the unused rest is released.
+    void commit(Reservation& reservation, Money used) {
+        used = std::max(Money(), std::min(used, reservation.amount));
+        debt.fetch_add(used.getMicros(), std::memory_order_relaxed);
+        headroom.fetch_add((reservation.amount - used).getMicros(), std::memory_order_acq_rel);
+        reservation.amount = Money();
+    }
+
+    void cancel(Reservation& reservation) {
+        headroom.fetch_add(reservation.amount.getMicros(), std::memory_order_acq_rel);
+        reservation.amount = Money();
+    }
+
+    // Pays off at most the current debt; the excess is not refunded and a
+    // negative amount pays nothing
+    void pay(Money amount) {
+        if (amount <= Money()) {
+            return;
+        }
+        int64_t current = debt.load(std::memory_order_relaxed);
+        int64_t paid;
+        do {
+            paid = std::min(amount.getMicros(), current);
+        } while (!debt.compare_exchange_weak(current, current - paid, std::memory_order_relaxed));
+        headroom.fetch_add(paid, std::memory_order_acq_rel);
+    }
+
+    void changeTheLimit(Money amount) {
+        int64_t old = limit.exchange(amount.getMicros(), std::memory_order_relaxed);
+        headroom.fetch_add(amount.getMicros() - old, std::memory_order_acq_rel);
+    }
+
+    Money getLimitingAmount() const {
+        return Money::fromMicros(limit.load(std::memory_order_relaxed));
+    }
+
+    Money getCurrentDebt() const {
+        return Money::fromMicros(debt.load(std::memory_order_relaxed));
+    }
+
+    Money getAvailable() const {
+        return Money::fromMicros(headroom.load(std::memory_order_acquire));
+    }
+
+private:
+    std::atomic<int64_t> limit;
+    std::atomic<int64_t> debt;
+    std::atomic<int64_t> headroom;
+
+    bool take(int64_t micros) {
+        int64_t available = headroom.load(std::memory_order_acquire);
+        do {
+            if (available < micros) {
+                return false;
+            }
+        } while (!headroom.compare_exchange_weak(available, available - micros, std::memory_order_acq_rel, std::memory_order_acquire));
+        return true;
+    }
+};
+
+// AtomicBill for every customer of a BillingStore, for front-end threads
+// that authorize charges while the store itself is not being mutated.
+// Accounts are not padded to cache lines; contention is per account and
+// padding would quadruple the memory for tens of millions of customers.
+class AuthorizationTable {
+private:
+    std::unique_ptr<AtomicBill[]> bills;
+    size_t count;
+
+public:
+    explicit AuthorizationTable(const BillingStore& store)
+        : bills(new AtomicBill[store.customerCount()]), count(store.customerCount()) {
+        for (size_t i = 0; i < count; ++i) {
+            bills[i].changeTheLimit(store.getLimit(i));
+            bills[i].add(store.getDebt(i));
+        }
+    }
+
+    AtomicBill& bill(size_t customer) {
+        return bills[customer];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Copies limits and debts back once every front-end thread has stopped.
+    // Open reservations are left out of the debt.
+    void writeBack(BillingStore& store) const {
+        for (size_t i = 0; i < count && i < store.customerCount(); ++i) {
+            Bill bill = store.bill(i);
+            bill.changeTheLimit(bills[i].getLimitingAmount());
+            bill.pay(bill.getCurrentDebt());
+            bill.add(bills[i].getCurrentDebt());
+        }
+    }
+};
+
+enum class ActionType : uint8_t {
+    Talk,
+    Message,
+    Connect,
+    Pay,
+    ChangeOperator,
+    ChangeBillLimit
+};
+
+// One element of "actions" with its IDs already resolved to dense indices
+struct Action {
+    ActionType type;
+    int32_t customer;
+    int32_t other;          // Receiving customer of a talk/message, new operator index of changeOperator
+    int32_t otherOperator;  // Operator of the receiving customer when the message was read
+    int32_t count;          // Minutes or messages
+    double amount;          // Connected amount of data
+    Money money;            // Payment or new limit
+    int64_t time;           // Seconds since the start of the billing cycle
+};
+
+// Prices the talk, message and connect actions of a run in batches. The
+// actions are grouped by operator and event kind, and every group is one
+// Operator::priceBatch call, so a plan's kernel is looked up once per group
+// and the standard plan runs its SIMD loops. The cost written for an action
+// is its price before the bill limit check. A price depends on the action
+// and the operator but never on a bill, so a run can be priced before any
+// of it is applied, given the operator of each customer at its position.
+class ActionPricer {
+private:
+    struct Item {
+        const Action* action;
+        Money* cost;
+        uint32_t key; // operatorIndex * 3 + kind
+    };
+
+    std::vector<Item> items;
+    std::vector<uint32_t> counts;     // By operator * 3 + kind; zero between calls
+    std::vector<uint32_t> keys;       // Keys in use, in order
+    std::vector<uint32_t> starts;     // First position of each key's group
+    std::vector<uint32_t> order;      // Items by group
+    std::vector<int> units;
+    std::vector<double> amounts;
+    std::vector<int> ages;
+    std::vector<int> otherOperatorIDs;
+    std::vector<int64_t> times;
+    std::vector<Money> debts;
+    std::vector<Money> limits;
+    std::vector<Money> costs;
+
+public:
+    // operatorIndex is the customer's operator at the position of the
+    // action. Other action types are ignored.
+    void add(const Action& action, int32_t operatorIndex, Money* cost) {
+        EventKind kind;
+        switch (action.type) {
+        case ActionType::Talk: kind = EventKind::Talk; break;
+        case ActionType::Message: kind = EventKind::Message; break;
+        case ActionType::Connect: kind = EventKind::Network; break;
+        default: return;
+        }
+        items.push_back({ &action, cost, static_cast<uint32_t>(operatorIndex) * 3 + static_cast<uint32_t>(kind) });
+    }
+
+    // Prices everything added since the last call and writes each cost
+    void price(const BillingStore& store) {
+        const size_t count = items.size();
+        if (count == 0) {
+            return;
+        }
+        // Counting sort by key, visiting only the keys in use; the columns
+        // are gathered straight into their group's positions
+        counts.resize(store.operatorCount() * 3, 0);
+        for (const Item& item : items) {
+            if (counts[item.key]++ == 0) {
+                keys.push_back(item.key);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        uint32_t position = 0;
+        for (uint32_t key : keys) {
+            starts.push_back(position);
+            position += counts[key];
+            counts[key] = starts.back();
+        }
+
+        order.resize(count);
+        units.resize(count);
+        amounts.resize(count);
+        ages.resize(count);
+        otherOperatorIDs.resize(count);
+        times.resize(count);
+        costs.resize(count);
+        // No bill is charged here: with no debt and no limit every event
+        // passes the check and its full price comes out
+        debts.resize(count);
+        limits.resize(count, Money::fromMicros(INT64_MAX));
+        for (size_t i = 0; i < count; ++i) {
+            const Action& action = *items[i].action;
+            uint32_t at = counts[items[i].key]++;
+            order[at] = static_cast<uint32_t>(i);
+            units[at] = action.count;
+            amounts[at] = action.amount;
+            ages[at] = store.getAge(action.customer);
+            otherOperatorIDs[at] = action.type == ActionType::Message ? store.getOperator(action.otherOperator).getID() : -1;
+            times[at] = action.time;
+        }
+        for (size_t group = 0; group < keys.size(); ++group) {
+            size_t first = starts[group];
+            size_t last = group + 1 < keys.size() ? starts[group + 1] : count;
+            PricingBatch batch;
+            batch.count = last - first;
+            batch.units = units.data() + first;
+            batch.amounts = amounts.data() + first;
+            batch.ages = ages.data() + first;
+            batch.otherOperatorIDs = otherOperatorIDs.data() + first;
+            batch.times = times.data() + first;
+            batch.debts = debts.data() + first;
+            batch.limits = limits.data() + first;
+            batch.costs = costs.data() + first;
+            store.getOperator(keys[group] / 3).priceBatch(static_cast<EventKind>(keys[group] % 3), batch);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            *items[order[i]].cost = costs[i];
+        }
+
+        for (uint32_t key : keys) {
+            counts[key] = 0;
+        }
+        keys.clear();
+        starts.clear();
+        items.clear();
+    }
+};
+
+// Applies actions on several threads with the same result as applying them
+// one by one. Customers are split into shards by blocks of 64 indices, and a
+// shard applies the actions of its customers in input order. Talk and message
+// also charge the receiving customer. When that customer lives in another
+// shard, the owner of the caller publishes the cost into a single-producer
+// lane of the receiver's inbox, and the receiver adds it when it reaches the
+// same position in its own action list. Every shard therefore sees the debts
+// of its customers change in exactly the sequential order. Waiting cannot
+// deadlock: the oldest pending credit always comes from an action whose
+// shard has already finished everything before it. Before applying its
+// actions a shard prices them all with an ActionPricer, using the operator
+// each customer had when the action was submitted.
+class ShardedExecutor {
+private:
+    static const uint32_t NoCredit = UINT32_MAX;
+
+    struct WorkItem {
+        uint32_t action;
+        uint32_t creditFrom; // Producer shard of a credit, NoCredit for an own action
+    };
+
+    struct alignas(64) Lane {
+        std::vector<Money> slots;
+        std::atomic<size_t> published{ 0 };
+        size_t produced = 0;
+        alignas(64) size_t consumed = 0;
+    };
+
+    BillingStore& store;
+    unsigned shardCount;
+    size_t batchSize;
+    std::vector<Action> batch;
+    std::vector<int32_t> batchOperators; // Operator of each action's customer when it was submitted
+    std::vector<Money> prices;           // Of each action, before the limit check
+    std::vector<ActionPricer> pricers;   // Per shard
+    std::vector<std::vector<WorkItem>> work;
+    std::unique_ptr<Lane[]> lanes;
+    std::vector<int32_t> operatorIndices;
+    std::vector<UsageRollup> usage; // Shared part of the rollup, per shard
+
+    unsigned shardOf(int32_t customer) const {
+        return static_cast<unsigned>(customer >> 6) % shardCount;
+    }
+
+    Lane& lane(unsigned producer, unsigned consumer) {
+        return lanes[producer * shardCount + consumer];
+    }
+
+    void recordUsage(unsigned shard, int32_t customer, UsageKind kind, double units, Money amount, int64_t time) {
+        UsageRollup& rollup = store.getUsage();
+        if (rollup.isEnabled()) {
+            rollup.addCustomer(customer, kind, units, amount);
+            usage[shard].addShared(customer, store.getOperatorIndex(customer), kind, units, amount, time);
+        }
+    }
+
+    // Adds the cost of a call or message to the bill of the receiver
+    void receive(const Action& action, unsigned shard, Money cost) {
+        if (cost > Money()) {
+            store.bill(action.other).add(cost);
+            UsageKind kind = action.type == ActionType::Talk ? UsageKind::IncomingTalk : UsageKind::IncomingMessage;
+            recordUsage(shard, action.other, kind, action.count, cost, action.time);
+        }
+    }
+
+    void credit(const Action& action, unsigned shard, Money cost) {
+        unsigned receiver = shardOf(action.other);
+        if (receiver == shard) {
+            receive(action, shard, cost);
+            return;
+        }
+        Lane& out = lane(shard, receiver);
+        out.slots[out.produced++] = cost;
+        out.published.store(out.produced, std::memory_order_release);
+    }
+
+    // The priced cost when the bill allows it, nothing otherwise
+    static Money charge(const Bill& bill, Money price) {
+        return price > Money() && bill.check(price) ? price : Money();
+    }
+
+    void execute(uint32_t index, unsigned shard) {
+        const Action& action = batch[index];
+        Bill bill = store.bill(action.customer);
+        switch (action.type) {
+        case ActionType::Talk: {
+            Money cost = charge(bill, prices[index]);
+            if (cost > Money()) {
+                bill.add(cost);
+                recordUsage(shard, action.customer, UsageKind::Talk, action.count, cost, action.time);
+            }
+            credit(action, shard, cost);
+            break;
+        }
+        case ActionType::Message: {
+            Money cost = charge(bill, prices[index]);
+            if (cost > Money()) {
+                bill.add(cost);
+                recordUsage(shard, action.customer, UsageKind::Message, action.count, cost, action.time);
+            }
+            credit(action, shard, cost);
+            break;
+        }
+        case ActionType::Connect: {
+            Money cost = charge(bill, prices[index]);
+            if (cost > Money()) {
+                bill.add(cost);
+                recordUsage(shard, action.customer, UsageKind::Network, action.amount, cost, action.time);
+            }
+            break;
+        }
+        case ActionType::Pay:
+            if (action.money > Money()) {
+                bill.pay(action.money);
+                recordUsage(shard, action.customer, UsageKind::Payment, 0, action.money, action.time);
+            }
+            break;
+        case ActionType::ChangeOperator:
+            store.setOperatorIndex(action.customer, action.other);
+            break;
+        case ActionType::ChangeBillLimit:
+            bill.changeTheLimit(action.money);
+            break;
+        }
+    }
+
+    void runShard(unsigned shard) {
+        ActionPricer& pricer = pricers[shard];
+        for (const WorkItem& item : work[shard]) {
+            if (item.creditFrom == NoCredit) {
+                pricer.add(batch[item.action], batchOperators[item.action], &prices[item.action]);
+            }
+        }
+        pricer.price(store);
+        for (const WorkItem& item : work[shard]) {
+            const Action& action = batch[item.action];
+            if (item.creditFrom == NoCredit) {
+                execute(item.action, shard);
+                continue;
+            }
+            Lane& in = lane(item.creditFrom, shard);
+            size_t next = in.consumed++;
+            for (unsigned spins = 0; in.published.load(std::memory_order_acquire) <= next; ++spins) {
+                if (spins > 64) {
+                    std::this_thread::yield();
+                }
+            }
+            receive(action, shard, in.slots[next]);
+        }
+    }
+
+    void runBatch() {
+        for (auto& items : work) {
+            items.clear();
+        }
+        std::vector<size_t> laneSizes(static_cast<size_t>(shardCount) * shardCount, 0);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const Action& action = batch[i];
+            unsigned owner = shardOf(action.customer);
+            work[owner].push_back({ static_cast<uint32_t>(i), NoCredit });
+            if (action.type == ActionType::Talk || action.type == ActionType::Message) {
+                unsigned receiver = shardOf(action.other);
+                if (receiver != owner) {
+                    work[receiver].push_back({ static_cast<uint32_t>(i), owner });
+                    ++laneSizes[owner * shardCount + receiver];
+                }
+            }
+        }
+        prices.resize(batch.size());
+        for (size_t i = 0; i < laneSizes.size(); ++i) {
+            lanes[i].slots.resize(laneSizes[i]);
+            lanes[i].published.store(0, std::memory_order_relaxed);
+            lanes[i].produced = 0;
+            lanes[i].consumed = 0;
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned shard = 1; shard < shardCount; ++shard) {
+            workers.emplace_back(&ShardedExecutor::runShard, this, shard);
+        }
+        runShard(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (store.getUsage().isEnabled()) {
+            for (UsageRollup& partial : usage) {
+                store.getUsage().merge(partial);
+            }
+        }
+        batch.clear();
+        batchOperators.clear();
+    }
+
+public:
+    ShardedExecutor(BillingStore& store, unsigned shardCount, size_t batchSize = 1 << 18)
+        : store(store), shardCount(std::max(1u, shardCount)), batchSize(batchSize), pricers(this->shardCount),
+        work(this->shardCount), lanes(new Lane[static_cast<size_t>(this->shardCount) * this->shardCount]),
+        usage(this->shardCount) {
+        batch.reserve(batchSize);
+        batchOperators.reserve(batchSize);
+    }
+
+    // Takes over the current operator of every customer. Must be called once
+    // the tables are complete and before the first submit.
+    void start() {
+        operatorIndices.resize(store.customerCount());
+        for (size_t i = 0; i < operatorIndices.size(); ++i) {
+            operatorIndices[i] = store.getOperatorIndex(i);
+        }
+        for (UsageRollup& partial : usage) {
+            partial.enable(store.getUsage().getBucketWidth());
+            partial.resize(0, store.operatorCount());
+        }
+    }
+
+    // Operator of a customer as of the last submitted action. The store lags
+    // behind until the batch holding a changeOperator has run.
+    int32_t getOperatorIndex(size_t customer) const {
+        return operatorIndices[customer];
+    }
+
+    void submit(const Action& action) {
+        batch.push_back(action);
+        batchOperators.push_back(operatorIndices[action.customer]);
+        if (action.type == ActionType::ChangeOperator) {
+            operatorIndices[action.customer] = action.other;
+        }
+        if (batch.size() >= batchSize) {
+            runBatch();
+        }
+    }
+
+    void flush() {
+        if (!batch.empty()) {
+            runBatch();
+        }
+    }
+};
+
+// On-disk form of one applied action in the write-ahead log. The sequence is
+// the position of the action in the "actions" array, so replay can skip what
+// a snapshot already contains; the checksum finds a record torn by a crash.
+// Customers and operators are stored by ID, not by dense index, so replay
+// resolves them against whatever tables it runs on.
+struct WalRecord {
+    uint64_t sequence;
+    int64_t time;
+    int64_t money;
+    double amount;
+    int32_t customer;       // Customer ID
+    int32_t other;          // Receiving customer ID of a talk/message, new operator ID of changeOperator
+    int32_t count;
+    uint8_t type;
+    uint8_t reserved[7];
+    uint32_t checksum;
+
+    // FNV-1a over every byte before the checksum
+    uint32_t computeChecksum() const {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(this);
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < offsetof(WalRecord, checksum); ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+static_assert(sizeof(WalRecord) == 56, "WAL records are fixed-size");
+
+// Append-only log of applied actions with group commit. Records are
+// buffered and written with a single write and fsync once groupSize records
+// are pending or the oldest pending record is groupMicros old, so the cost
+// of an fsync is shared by the whole group. A crash loses at most the last
+// uncommitted group, which the input can provide again. A commit that fails
+// cuts the file back to the end of the last good one and keeps its records
+// pending; the next commit tries them again.
+class WriteAheadLog {
+public:
+    static constexpr char Magic[8] = { 'B', 'I', 'L', 'L', 'W', 'A', 'L', '2' };
+
+    WriteAheadLog() : file(nullptr), groupSize(1), groupMicros(0), commitAt(1), committedBytes(0), committedRecords(0), commits(0) {}
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        close();
+    }
+
+    bool open(const std::string& path, size_t groupSize, uint64_t groupMicros) {
+        close();
+        file = std::fopen(path.c_str(), "ab");
+        if (file == nullptr) {
+            std::cerr << "Error: Unable to open write-ahead log " << path << "." << std::endl;
+            return false;
+        }
+        // Unbuffered, so a failed commit leaves nothing behind in the stream
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        this->groupSize = std::max<size_t>(1, groupSize);
+        this->groupMicros = groupMicros;
+        commitAt = this->groupSize;
+        pending.reserve(this->groupSize);
+        std::fseek(file, 0, SEEK_END);
+        committedBytes = static_cast<uint64_t>(std::ftell(file));
+        if (committedBytes == 0) {
+            if (std::fwrite(Magic, sizeof(Magic), 1, file) != 1 || !sync()) {
+                close();
+                return false;
+            }
+            committedBytes = sizeof(Magic);
+        }
+        return true;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Adds an action whose indices refer to the tables of store; false if
+    // the commit it started failed
+    bool append(uint64_t sequence, const Action& action, const BillingStore& store) {
+        if (pending.empty()) {
+            oldestPending = std::chrono::steady_clock::now();
+        }
+        WalRecord record = {};
+        record.sequence = sequence;
+        record.time = action.time;
+        record.money = action.money.getMicros();
+        record.amount = action.amount;
+        record.customer = store.getCustomerID(action.customer);
+        if (action.type == ActionType::Talk || action.type == ActionType::Message) {
+            record.other = store.getCustomerID(action.other);
+        }
+        else if (action.type == ActionType::ChangeOperator) {
+            record.other = store.getOperator(action.other).getID();
+        }
+        record.count = action.count;
+        record.type = static_cast<uint8_t>(action.type);
+        record.checksum = record.computeChecksum();
+        pending.push_back(record);
+
+        if (pending.size() >= commitAt || (groupMicros != 0 && commitAt == groupSize
+            && std::chrono::steady_clock::now() - oldestPending >= std::chrono::microseconds(groupMicros))) {
+            return commit();
+        }
+        return true;
+    }
+
+    // Writes and syncs every pending record. On failure they stay pending,
+    // and append waits until twice as many are pending before it tries again.
+    // The group time limit does not apply until a commit succeeds.
+    bool commit() {
+        if (file == nullptr || pending.empty()) {
+            return true;
+        }
+        if (std::fwrite(pending.data(), sizeof(WalRecord), pending.size(), file) != pending.size() || !sync()) {
+            std::cerr << "Error: Write-ahead log commit failed, " << pending.size() << " actions are not logged yet." << std::endl;
+            rollBack();
+            commitAt = pending.size() * 2;
+            return false;
+        }
+        committedBytes += pending.size() * sizeof(WalRecord);
+        committedRecords += pending.size();
+        ++commits;
+        commitAt = groupSize;
+        pending.clear();
+        return true;
+    }
+
+    // False if actions were left out of the log
+    bool close() {
+        bool ok = true;
+        if (file != nullptr) {
+            ok = commit();
+            ok = std::fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+        if (!pending.empty()) {
+            std::cerr << "Error: " << pending.size() << " actions were never written to the write-ahead log." << std::endl;
+            pending.clear();
+        }
+        return ok;
+    }
+
+    uint64_t getCommittedRecords() const {
+        return committedRecords;
+    }
+
+    uint64_t getCommits() const {
+        return commits;
+    }
+
+private:
+    FILE* file;
+    size_t groupSize;
+    uint64_t groupMicros;
+    size_t commitAt; // Pending records that start a commit
+    std::vector<WalRecord> pending;
+    std::chrono::steady_clock::time_point oldestPending;
+    uint64_t committedBytes;
+    uint64_t committedRecords;
+    uint64_t commits;
+
+    // Drops whatever a failed commit got into the file
+    void rollBack() {
+        std::clearerr(file);
+#if defined(_WIN32)
+        bool ok = _chsize_s(_fileno(file), static_cast<__int64>(committedBytes)) == 0;
+#else
+        bool ok = ftruncate(fileno(file), static_cast<off_t>(committedBytes)) == 0;
+#endif
+        if (!ok) {
+            std::cerr << "Error: Unable to cut the write-ahead log back to its last commit." << std::endl;
+        }
+    }
+
+    bool sync() {
+        if (std::fflush(file) != 0) {
+            return false;
+        }
+#if defined(_WIN32)
+        return _commit(_fileno(file)) == 0;
+#else
+        return fdatasync(fileno(file)) == 0;
+#endif
+    }
+};
+
+// Reads a write-ahead log back. Reading stops at the first incomplete or
+// corrupt record, which can only be the tail of the last group before a crash.
+class WalReader {
+private:
+    std::ifstream input;
+    bool valid;
+
+public:
+    explicit WalReader(const std::string& path) : input(path, std::ios::binary), valid(false) {
+        char magic[sizeof(WriteAheadLog::Magic)];
+        valid = input.read(magic, sizeof(magic)) && std::memcmp(magic, WriteAheadLog::Magic, sizeof(magic)) == 0;
+    }
+
+    bool isValid() const {
+        return valid;
+    }
+
+    // False at the end of the log or at a torn record. The action holds
+    // customer and operator IDs, not indices.
+    bool next(uint64_t& sequence, Action& action) {
+        WalRecord record;
+        if (!valid || !input.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            return false;
+        }
+        if (record.checksum != record.computeChecksum() || record.type > static_cast<uint8_t>(ActionType::ChangeBillLimit)) {
+            std::cerr << "Error: Write-ahead log is torn after sequence " << sequence << "." << std::endl;
+            valid = false;
+            return false;
+        }
+        sequence = record.sequence;
+        action = Action{};
+        action.type = static_cast<ActionType>(record.type);
+        action.customer = record.customer;
+        action.other = record.other;
+        action.count = record.count;
+        action.amount = record.amount;
+        action.money = Money::fromMicros(record.money);
+        action.time = record.time;
+        return true;
+    }
+};
+
+// Applies the records of input.json to the BillingStore. Customers may be
+// listed before the operators and bills they refer to, so their operator IDs
+// and limits are resolved once, right before the first action is applied.
+// Actions are applied in order through Customer, or handed to a
+// ShardedExecutor when one is given. Without an executor they are held in a
+// window of up to PendingSize actions that an ActionPricer prices together
+// before they are applied; a changeOperator closes the window, so every
+// price in it uses the operator the customer has when the action applies.
+// flush applies what is held. With checkpoints enabled the store is
+// written to a Snapshot every checkpointInterval elements of "actions"; a
+// processor resumed from a snapshot ignores the tables of the input and
+// skips the elements the snapshot already contains. Every applied action is
+// appended to the WriteAheadLog, if one is given, before it takes effect;
+// the log is also committed every PendingSize actions and on flush, so no
+// record waits for a later append.
+class ActionProcessor {
+private:
+    static constexpr size_t PendingSize = 4096;
+
+    BillingStore& store;
+    ShardedExecutor* executor;
+    WriteAheadLog* log;
+    ActionPricer pricer;
+    std::vector<Action> pending;
+    std::vector<Money> pendingPrices;
+    std::vector<int> pendingOperatorIDs;
+    std::vector<double> pendingLimits;
+    std::vector<double> billLimits;
+    bool tablesReady;
+    bool resumed;
+    bool tablesOnly;
+    size_t appliedActions;
+    size_t skippedActions;
+    uint64_t actionRecords;
+    uint64_t resumeRecords;
+    uint64_t checkpointInterval;
+    std::string snapshotPath;
+
+    void skip(const std::string& type, const std::string& reason) {
+        ++skippedActions;
+        std::cerr << "Error: Skipping \"" << type << "\" action: " << reason << std::endl;
+    }
+
+    void applyPending() {
+        pendingPrices.resize(pending.size());
+        for (size_t i = 0; i < pending.size(); ++i) {
+            pricer.add(pending[i], store.getOperatorIndex(pending[i].customer), &pendingPrices[i]);
+        }
+        pricer.price(store);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            applyPriced(pending[i], pendingPrices[i]);
+        }
+        pending.clear();
+    }
+
+    void applyPriced(const Action& action, Money price) {
+        Customer customer = store.customer(action.customer);
+        switch (action.type) {
+        case ActionType::Talk: {
+            Customer other = store.customer(action.other);
+            customer.talkPriced(action.count, other, price, action.time);
+            break;
+        }
+        case ActionType::Message: {
+            Customer other = store.customer(action.other);
+            customer.messagePriced(action.count, other, price, action.time);
+            break;
+        }
+        case ActionType::Connect:
+            customer.connectionPriced(action.amount, price, action.time);
+            break;
+        case ActionType::Pay:
+            customer.payBill(action.money, action.time);
+            break;
+        case ActionType::ChangeOperator:
+            customer.changeOperator(&store.getOperator(action.other), action.time);
+            break;
+        case ActionType::ChangeBillLimit:
+            customer.changeBillLimit(action.money, action.time);
+            break;
+        }
+    }
+
+public:
+    ActionProcessor(BillingStore& store, ShardedExecutor* executor = nullptr)
+        : store(store), executor(executor), log(nullptr), tablesReady(false), resumed(false), tablesOnly(false),
+        appliedActions(0), skippedActions(0),
+        actionRecords(0), resumeRecords(0), checkpointInterval(0) {}
+
+    void enableCheckpoints(const std::string& path, uint64_t interval) {
+        snapshotPath = path;
+        checkpointInterval = interval;
+    }
+
+    void enableLog(WriteAheadLog* log) {
+        this->log = log;
+    }
+
+    // The "actions" of the input are ignored; they come from a log instead
+    void ignoreActions() {
+        tablesOnly = true;
+    }
+
+    // The store was loaded from a snapshot taken after the given number of
+    // "actions" elements
+    void resumeAfter(uint64_t records) {
+        resumed = true;
+        resumeRecords = records;
+        actionRecords = 0;
+    }
+
+    // Applies everything submitted so far and writes the snapshot. The log is
+    // committed first so it never ends before the snapshot does; if it
+    // cannot be, no snapshot is written.
+    bool checkpoint() {
+        if (log != nullptr && !log->commit()) {
+            std::cerr << "Error: Checkpoint skipped, the write-ahead log is behind." << std::endl;
+            flush();
+            return false;
+        }
+        flush();
+        return Snapshot::write(store, actionRecords, snapshotPath);
+    }
+
+    // Applies every action handed over so far
+    void flush() {
+        if (log != nullptr) {
+            log->commit();
+        }
+        if (!pending.empty()) {
+            applyPending();
+        }
+        if (executor != nullptr) {
+            executor->flush();
+        }
+    }
+
+    // A record with a field of the wrong type is skipped like an action
+    // that cannot be applied
+    void addRecord(const std::string& section, const json& record) {
+        try {
+            readRecord(section, record);
+        }
+        catch (const json::exception& ex) {
+            std::cerr << "Error: Skipping \"" << section << "\" record: " << ex.what() << std::endl;
+        }
+    }
+
+    void readRecord(const std::string& section, const json& record) {
+        if (section == "actions") {
+            if (!tablesOnly) {
+                apply(record);
+            }
+            return;
+        }
+        if (resumed) {
+            return;
+        }
+        if (tablesReady) {
+            std::cerr << "Error: \"" << section << "\" record after the first action is ignored." << std::endl;
+            return;
+        }
+        if (section == "customers") {
+            // Every field is read before the customer is added, so a bad one
+            // leaves nothing behind
+            int ID = record.value("ID", 0);
+            std::string name = record.value("name", "");
+            int age = record.value("age", 0);
+            int operatorID = record.value("operatorID", 0);
+            double billLimit = record.value("billLimit", std::nan(""));
+            if (store.addCustomer(ID, name, age, -1, Money()) < 0) {
+                std::cerr << "Error: Duplicate customer " << ID << " is ignored." << std::endl;
+                return;
+            }
+            pendingOperatorIDs.push_back(operatorID);
+            pendingLimits.push_back(billLimit);
+        }
+        else if (section == "operators") {
+            int plan = TariffRegistry::find(record.value("plan", "standard"));
+            if (plan < 0) {
+                std::cerr << "Error: Operator " << record.value("ID", 0) << " has an unknown plan, using \"standard\"." << std::endl;
+                plan = 0;
+            }
+            Operator op(record.value("ID", 0), Money::fromDouble(record.value("talkingCharge", 0.0)),
+                Money::fromDouble(record.value("messageCost", 0.0)), Money::fromDouble(record.value("networkCharge", 0.0)),
+                record.value("discountRate", 0), plan);
+            if (store.addOperator(op) < 0) {
+                std::cerr << "Error: Duplicate operator " << op.getID() << " is ignored." << std::endl;
+            }
+        }
+        else if (section == "bills") {
+            billLimits.push_back(record.value("limitingAmount", 0.0));
+        }
+    }
+
+    // Resolves operator IDs to operator indices and sets every bill limit.
+    // The "billLimit" of a customer wins over the "bills" entry at the same
+    // position. Customers with an unknown operator keep no operator and
+    // their actions are skipped.
+    void finalizeTables() {
+        if (tablesReady) {
+            return;
+        }
+        tablesReady = true;
+        store.getUsage().resize(store.customerCount(), store.operatorCount());
+        if (resumed) {
+            if (executor != nullptr) {
+                executor->start();
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < pendingOperatorIDs.size(); ++i) {
+            Customer customer = store.customer(i);
+            int32_t operatorIndex = store.findOperator(pendingOperatorIDs[i]);
+            if (operatorIndex < 0) {
+                std::cerr << "Error: Customer " << customer.getID() << " refers to an unknown operator." << std::endl;
+            }
+            store.setOperatorIndex(i, operatorIndex);
+
+            double limit = pendingLimits[i];
+            if (std::isnan(limit)) {
+                limit = i < billLimits.size() ? billLimits[i] : 0.0;
+            }
+            customer.getBill().changeTheLimit(Money::fromDouble(limit));
+        }
+        pendingOperatorIDs = std::vector<int>();
+        pendingLimits = std::vector<double>();
+        billLimits = std::vector<double>();
+
+        if (executor != nullptr) {
+            executor->start();
+        }
+    }
+
+    // Operator of a customer at the current position of the action stream
+    int32_t currentOperator(int32_t customer) const {
+        return executor != nullptr ? executor->getOperatorIndex(customer) : store.getOperatorIndex(customer);
+    }
+
+    // Resolves the IDs of a record; false if the action has to be skipped
+    bool decode(const json& record, Action& action) {
+        const std::string type = record.value("type", "");
+        action = Action{};
+        action.time = record.value("time", int64_t(0));
+        action.customer = store.findCustomer(record.value("customerID", -1));
+        if (action.customer < 0) {
+            skip(type, "unknown customer " + std::to_string(record.value("customerID", -1)));
+            return false;
+        }
+        if (currentOperator(action.customer) < 0) {
+            skip(type, "customer " + std::to_string(store.getCustomerID(action.customer)) + " has no operator");
+            return false;
+        }
+
+        if (type == "talk" || type == "message") {
+            action.type = type == "talk" ? ActionType::Talk : ActionType::Message;
+            action.count = type == "talk" ? record.value("minutes", 0) : record.value("quantity", 0);
+            action.other = store.findCustomer(record.value("otherCustomerID", -1));
+            if (action.other < 0) {
+                skip(type, "unknown customer " + std::to_string(record.value("otherCustomerID", -1)));
+                return false;
+            }
+            action.otherOperator = currentOperator(action.other);
+            if (action.otherOperator < 0) {
+                skip(type, "customer " + std::to_string(store.getCustomerID(action.other)) + " has no operator");
+                return false;
+            }
+        }
+        else if (type == "connect") {
+            action.type = ActionType::Connect;
+            action.amount = record.value("amount", 0.0);
+        }
+        else if (type == "pay") {
+            action.type = ActionType::Pay;
+            action.money = Money::fromDouble(record.value("amount", 0.0));
+        }
+        else if (type == "changeOperator") {
+            action.type = ActionType::ChangeOperator;
+            action.other = store.findOperator(record.value("newOperatorID", -1));
+            if (action.other < 0) {
+                skip(type, "unknown operator " + std::to_string(record.value("newOperatorID", -1)));
+                return false;
+            }
+        }
+        else if (type == "changeBillLimit") {
+            action.type = ActionType::ChangeBillLimit;
+            action.money = Money::fromDouble(record.value("newLimit", 0.0));
+        }
+        else {
+            skip(type, "unknown action type");
+            return false;
+        }
+        return true;
+    }
+
+    void apply(const json& record) {
+        finalizeTables();
+        if (++actionRecords <= resumeRecords) {
+            return;
+        }
+        try {
+            applyRecord(record);
+        }
+        catch (const json::exception& ex) {
+            auto type = record.find("type");
+            skip(type != record.end() && type->is_string() ? type->get<std::string>() : "", ex.what());
+        }
+        if (checkpointInterval != 0 && actionRecords % checkpointInterval == 0) {
+            checkpoint();
+        }
+    }
+
+    void applyRecord(const json& record) {
+        Action action;
+        if (!decode(record, action)) {
+            return;
+        }
+        if (log != nullptr) {
+            log->append(actionRecords, action, store);
+            if ((appliedActions + 1) % PendingSize == 0) {
+                log->commit();
+            }
+        }
+        applyAction(action);
+    }
+
+    // Turns the IDs of a logged action into indices; false if the tables
+    // have no such customer or operator
+    bool resolve(Action& action) {
+        action.customer = store.findCustomer(action.customer);
+        if (action.customer < 0 || currentOperator(action.customer) < 0) {
+            return false;
+        }
+        if (action.type == ActionType::Talk || action.type == ActionType::Message) {
+            action.other = store.findCustomer(action.other);
+            action.otherOperator = action.other >= 0 ? currentOperator(action.other) : -1;
+            return action.otherOperator >= 0;
+        }
+        if (action.type == ActionType::ChangeOperator) {
+            action.other = store.findOperator(action.other);
+            return action.other >= 0;
+        }
+        return true;
+    }
+
+    // Rebuilds the state after the tables by applying every action of the
+    // log that is not already in the store. Records are in sequence order;
+    // ones repeated by a run resumed from an older snapshot are applied once.
+    size_t replay(WalReader& reader) {
+        finalizeTables();
+        size_t replayed = 0;
+        uint64_t sequence = 0;
+        Action action;
+        while (reader.next(sequence, action)) {
+            if (sequence <= std::max(actionRecords, resumeRecords)) {
+                continue;
+            }
+            actionRecords = sequence;
+            if (!resolve(action)) {
+                ++skippedActions;
+                std::cerr << "Error: Logged action " << sequence << " does not match the customers and operators of the input." << std::endl;
+                continue;
+            }
+            applyAction(action);
+            ++replayed;
+        }
+        return replayed;
+    }
+
+    // Applies an action whose IDs are already resolved, at the latest on
+    // the next flush
+    void applyAction(const Action& action) {
+        ++appliedActions;
+        if (executor != nullptr) {
+            executor->submit(action);
+            return;
+        }
+        pending.push_back(action);
+        if (action.type == ActionType::ChangeOperator || pending.size() == PendingSize) {
+            applyPending();
+        }
+    }
+
+    size_t getAppliedActions() const {
+        return appliedActions;
+    }
+
+    size_t getSkippedActions() const {
+        return skippedActions;
+    }
+};
+
+// SAX handler over input.json. Only the record being parsed is kept in
+// memory: each element of a top-level array is handed to the ActionProcessor
+// as soon as its closing brace is seen, so an "actions" array of any length
+// is applied in a single pass with constant memory.
+class InputStreamHandler : public json::json_sax_t {
+private:
+    ActionProcessor& processor;
+    std::string section;
+    std::string currentKey;
+    json record;
+    int depth;
+    int skippedDepth;
+
+    // Depth 1 is the root object, 2 a table array and 3 one of its records.
+    bool inRecord() const {
+        return depth == 3 && skippedDepth == 0;
+    }
+
+    bool value(json&& v) {
+        if (inRecord()) {
+            record[currentKey] = std::move(v);
+        }
+        return true;
+    }
+
+public:
+    InputStreamHandler(ActionProcessor& processor) : processor(processor), depth(0), skippedDepth(0) {}
+
+    bool null() override { return value(nullptr); }
+    bool boolean(bool val) override { return value(val); }
+    bool number_integer(number_integer_t val) override { return value(val); }
+    bool number_unsigned(number_unsigned_t val) override { return value(val); }
+    bool number_float(number_float_t val, const string_t&) override { return value(val); }
+    bool string(string_t& val) override { return value(std::move(val)); }
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override {
+        ++depth;
+        if (depth == 3) {
+            record = json::object();
+        }
+        else if (depth > 3) {
+            ++skippedDepth; // Nested values are not part of the schema
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        if (depth > 3) {
+            --skippedDepth;
+        }
+        else if (depth == 3) {
+            processor.addRecord(section, record);
+        }
+        --depth;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        ++depth;
+        if (depth > 2) {
+            ++skippedDepth;
+        }
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth > 2) {
+            --skippedDepth;
+        }
+        --depth;
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (depth == 1) {
+            section = val;
+        }
+        else {
+            currentKey = val;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        std::cerr << "Error: Malformed input at byte " << position << ": " << ex.what() << std::endl;
+        return false;
+    }
+};
+
+
+enum class OutputFormat {
+    Pretty,
+    JsonLines
+};
+
+struct RunOptions {
+    unsigned threads = 1;
+    std::string snapshotPath;
+    uint64_t checkpointInterval = 0;
+    bool resume = false;
+    std::string logPath;
+    size_t groupCommitSize = 64;
+    uint64_t groupCommitMicros = 1000;
+    std::string replayPath;
+    bool events = true;
+    EventFormat eventFormat = EventFormat::Text;
+    std::string eventsPath;
+    int64_t usageBucketSeconds = 0; // Zero keeps no usage rollup; --usage defaults it to a day
+    std::string usagePath;
+    std::string outputPath = "output.json";
+    OutputFormat outputFormat = OutputFormat::Pretty;
+    unsigned outputChunks = 1;
+};
+
+// Function to read input from a JSON file. Actions are applied while the file
+// is being parsed; the whole document is never held in memory. Their events
+// go to an AsyncEventSink on stdout or the events file. With more than one
+// thread they run on a ShardedExecutor and no events are written; main
+// refuses an explicit event stream in that case. With
+// resume set, the snapshot replaces the tables of the input and the
+// actions it already contains are skipped; a missing or unusable snapshot
+// is an error. With a replay path the actions of the input are ignored and
+// the ones in the write-ahead log are applied. With a snapshot path a final
+// snapshot is written at the end, checkpoints or not. False if the input or
+// the snapshot could not be read, the input is malformed, or a snapshot or
+// the log not written. What was applied before a malformed part is kept.
+bool readInputFromJSON(const std::string& filename, BillingStore& store, const RunOptions& options) {
+    std::ifstream input(filename);
+    if (!input.is_open()) {
+        std::cerr << "Error: Unable to open input file." << std::endl;
+        return false;
+    }
+
+    uint64_t resumeRecords = 0;
+    if (options.resume) {
+        if (!Snapshot::load(store, options.snapshotPath, resumeRecords)) {
+            std::cerr << "Error: Unable to resume from snapshot " << options.snapshotPath << "." << std::endl;
+            return false;
+        }
+        std::cout << "Resuming from " << options.snapshotPath << " after " << resumeRecords << " actions." << std::endl;
+    }
+
+    store.getUsage().enable(options.usageBucketSeconds);
+
+    std::unique_ptr<ShardedExecutor> executor;
+    if (options.threads > 1) {
+        executor.reset(new ShardedExecutor(store, options.threads));
+    }
+
+    const bool reportEvents = options.events && !executor;
+    FILE* eventsFile = stdout;
+    if (reportEvents && !options.eventsPath.empty()) {
+        eventsFile = std::fopen(options.eventsPath.c_str(), options.eventFormat == EventFormat::Binary ? "wb" : "w");
+        if (eventsFile == nullptr) {
+            std::cerr << "Error: Unable to open events file " << options.eventsPath << "." << std::endl;
+            return false;
+        }
+    }
+    std::unique_ptr<AsyncEventSink> events;
+    if (reportEvents) {
+        events.reset(new AsyncEventSink(store, eventsFile, options.eventFormat));
+        store.setEventSink(events.get());
+    }
+
+    ActionProcessor processor(store, executor.get());
+    if (options.resume) {
+        processor.resumeAfter(resumeRecords);
+    }
+    if (!options.snapshotPath.empty()) {
+        processor.enableCheckpoints(options.snapshotPath, options.checkpointInterval);
+    }
+    WriteAheadLog log;
+    if (!options.logPath.empty() && log.open(options.logPath, options.groupCommitSize, options.groupCommitMicros)) {
+        processor.enableLog(&log);
+    }
+    if (!options.replayPath.empty()) {
+        processor.ignoreActions();
+    }
+    InputStreamHandler handler(processor);
+    bool parsed = json::sax_parse(input, &handler);
+    processor.finalizeTables();
+    size_t replayed = 0;
+    if (!options.replayPath.empty()) {
+        WalReader reader(options.replayPath);
+        if (!reader.isValid()) {
+            std::cerr << "Error: " << options.replayPath << " is not a write-ahead log." << std::endl;
+        }
+        else {
+            replayed = processor.replay(reader);
+        }
+    }
+    processor.flush();
+    bool saved = options.snapshotPath.empty() || processor.checkpoint();
+    bool logged = log.close();
+    if (events) {
+        events->close();
+        store.setEventSink(nullptr);
+    }
+    if (eventsFile != nullptr && eventsFile != stdout) {
+        std::fclose(eventsFile);
+    }
+
+    if (!options.replayPath.empty()) {
+        std::cout << "Replayed " << replayed << " actions from " << options.replayPath << "." << std::endl;
+    }
+    if (log.getCommits() != 0) {
+        std::cout << "Logged " << log.getCommittedRecords() << " actions in " << log.getCommits() << " commits." << std::endl;
+    }
+
+    std::cout << "Applied " << processor.getAppliedActions() << " actions, skipped " << processor.getSkippedActions() << "." << std::endl;
+    return parsed && saved && logged;
+}
+
+// Streams customer records from the store into a file without building a
+// DOM. Pretty is the layout json::dump(4) produced: sorted keys, 4-space
+// indent. JsonLines writes one compact record per line. Amounts are written
+// as the exact decimal of their Money value.
+class OutputWriter {
+private:
+    static const size_t BufferSize = 1 << 20;
+
+    const BillingStore& store;
+    OutputFormat format;
+    FILE* file;
+    std::string buffer;
+    bool ok;
+
+    void appendInteger(int64_t value) {
+        char digits[24];
+        buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    // Keeps amounts floating-point numbers, 2 is written as 2.0
+    void appendAmount(Money amount) {
+        appendMoney(buffer, amount);
+        if (amount.getMicros() % Money::MicrosPerUnit == 0) {
+            buffer += ".0";
+        }
+    }
+
+    void appendString(std::string_view text) {
+        static const char Hex[] = "0123456789abcdef";
+        buffer += '"';
+        for (char c : text) {
+            switch (c) {
+            case '"': buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\b': buffer += "\\b"; break;
+            case '\f': buffer += "\\f"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            case '\t': buffer += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    buffer += "\\u00";
+                    buffer += Hex[(c >> 4) & 0xF];
+                    buffer += Hex[c & 0xF];
+                }
+                else {
+                    buffer += c;
+                }
+            }
+        }
+        buffer += '"';
+    }
+
+    void appendCustomer(size_t index) {
+        const int32_t operatorIndex = store.getOperatorIndex(index);
+        const int operatorID = operatorIndex >= 0 ? store.getOperator(operatorIndex).getID() : -1;
+        if (format == OutputFormat::JsonLines) {
+            buffer += "{\"ID\":";
+            appendInteger(store.getCustomerID(index));
+            buffer += ",\"age\":";
+            appendInteger(store.getAge(index));
+            buffer += ",\"bill\":{\"currentDebt\":";
+            appendAmount(store.getDebt(index));
+            buffer += ",\"limitingAmount\":";
+            appendAmount(store.getLimit(index));
+            buffer += "},\"name\":";
+            appendString(store.getName(index));
+            buffer += ",\"operatorID\":";
+            appendInteger(operatorID);
+            buffer += "}\n";
+            return;
+        }
+        buffer += "        {\n            \"ID\": ";
+        appendInteger(store.getCustomerID(index));
+        buffer += ",\n            \"age\": ";
+        appendInteger(store.getAge(index));
+        buffer += ",\n            \"bill\": {\n                \"currentDebt\": ";
+        appendAmount(store.getDebt(index));
+        buffer += ",\n                \"limitingAmount\": ";
+        appendAmount(store.getLimit(index));
+        buffer += "\n            },\n            \"name\": ";
+        appendString(store.getName(index));
+        buffer += ",\n            \"operatorID\": ";
+        appendInteger(operatorID);
+        buffer += "\n        }";
+    }
+
+    // Once a write has failed nothing more is written
+    void drain() {
+        if (ok && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            ok = false;
+        }
+        buffer.clear();
+    }
+
+public:
+    OutputWriter(const BillingStore& store, OutputFormat format) : store(store), format(format), file(nullptr), ok(true) {}
+
+    // Writes the customers [first, last) as a complete document; false if
+    // the file could not be opened or written
+    bool write(const std::string& filename, size_t first, size_t last) {
+        file = std::fopen(filename.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "Error: Unable to open output file " << filename << "." << std::endl;
+            return false;
+        }
+        buffer.reserve(BufferSize + 4096);
+        if (format == OutputFormat::Pretty) {
+            buffer += first == last ? "{\n    \"customers\": []\n}" : "{\n    \"customers\": [\n";
+        }
+        for (size_t i = first; i < last; ++i) {
+            appendCustomer(i);
+            if (format == OutputFormat::Pretty) {
+                buffer += i + 1 < last ? ",\n" : "\n    ]\n}";
+            }
+            if (buffer.size() >= BufferSize) {
+                drain();
+            }
+        }
+        drain();
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        if (!ok) {
+            std::cerr << "Error: Unable to write output file " << filename << "." << std::endl;
+        }
+        return ok;
+    }
+};
+
+// Name of chunk i of an output file: output.json becomes output.i.json
+std::string chunkFilename(const std::string& filename, size_t chunk) {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = filename.size();
+    }
+    return filename.substr(0, dot) + "." + std::to_string(chunk) + filename.substr(dot);
+}
+
+// Function to write output to a JSON file. With more than one chunk the
+// customers are split into that many ranges, each written to its own file
+// by its own thread. False if any file could not be written.
+bool writeOutputToJSON(const std::string& filename, const BillingStore& store, OutputFormat format = OutputFormat::Pretty, unsigned chunks = 1) {
+    const size_t count = store.customerCount();
+    if (chunks <= 1) {
+        return OutputWriter(store, format).write(filename, 0, count);
+    }
+
+    std::vector<std::thread> writers;
+    std::vector<char> written(chunks, 0);
+    for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+        size_t first = count * chunk / chunks;
+        size_t last = count * (chunk + 1) / chunks;
+        writers.emplace_back([&store, &written, format, chunk, first, last, name = chunkFilename(filename, chunk)]() {
+            written[chunk] = OutputWriter(store, format).write(name, first, last);
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    return std::all_of(written.begin(), written.end(), [](char chunkWritten) { return chunkWritten != 0; });
+}
+
+json usageToJSON(const UsageTotals& totals) {
+    static const char* const Kinds[UsageKindCount] = { "talk", "message", "network", "incomingTalk", "incomingMessage", "payment" };
+    json record;
+    for (size_t i = 0; i < UsageKindCount; ++i) {
+        record[Kinds[i]] = { { "count", totals.count[i] }, { "units", totals.getUnits(static_cast<UsageKind>(i)) }, { "amount", totals.amount[i].toDouble() } };
+    }
+    return record;
+}
+
+// Writes the usage rollup of every operator and customer, in total and in
+// the bucket of the latest action. False if the file could not be written.
+bool writeUsageToJSON(const std::string& filename, const BillingStore& store) {
+    const UsageRollup& usage = store.getUsage();
+    int64_t bucket = usage.bucketOf(usage.getLatestTime());
+    json outputData;
+
+    outputData["bucketWidth"] = usage.getBucketWidth();
+    outputData["bucket"] = bucket;
+    outputData["operators"] = json::array();
+    for (size_t i = 0; i < store.operatorCount(); ++i) {
+        json record;
+        record["ID"] = store.getOperator(i).getID();
+        record["total"] = usageToJSON(usage.getOperator(i));
+        record["currentBucket"] = usageToJSON(usage.operatorBucket(static_cast<int32_t>(i), bucket));
+        outputData["operators"].push_back(record);
+    }
+    outputData["customers"] = json::array();
+    for (size_t i = 0; i < store.customerCount(); ++i) {
+        json record;
+        record["ID"] = store.getCustomerID(i);
+        record["total"] = usageToJSON(usage.customer(i));
+        record["currentBucket"] = usageToJSON(usage.customerBucket(static_cast<int32_t>(i), bucket));
+        outputData["customers"].push_back(record);
+    }
+
+    std::ofstream output(filename);
+    output << std::setw(4) << outputData;
+    output.close();
+    if (!output) {
+        std::cerr << "Error: Unable to write usage file " << filename << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#ifndef LAB_NO_MAIN
+int main(int argc, char* argv[]) {
+    RunOptions options;
+    bool eventsRequested = false; // --events other than none, or --events-file
+    bool validArguments = argc >= 2;
+    for (int i = 2; i < argc && validArguments; ++i) {
+        const std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--threads" && hasValue) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (argument == "--snapshot" && hasValue) {
+            options.snapshotPath = argv[++i];
+        }
+        else if (argument == "--checkpoint" && hasValue) {
+            options.checkpointInterval = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--resume") {
+            options.resume = true;
+        }
+        else if (argument == "--wal" && hasValue) {
+            options.logPath = argv[++i];
+        }
+        else if (argument == "--group-commit" && hasValue) {
+            options.groupCommitSize = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (argument == "--group-micros" && hasValue) {
+            options.groupCommitMicros = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        }
+        else if (argument == "--events" && hasValue) {
+            const std::string format = argv[++i];
+            options.events = format != "none";
+            eventsRequested = options.events;
+            options.eventFormat = format == "jsonl" ? EventFormat::JsonLines : format == "binary" ? EventFormat::Binary : EventFormat::Text;
+            validArguments = format == "none" || format == "text" || format == "jsonl" || format == "binary";
+        }
+        else if (argument == "--events-file" && hasValue) {
+            options.eventsPath = argv[++i];
+            eventsRequested = true;
+        }
+        else if (argument == "--usage-bucket" && hasValue) {
+            options.usageBucketSeconds = std::max<int64_t>(0, std::strtoll(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--usage" && hasValue) {
+            options.usagePath = argv[++i];
+        }
+        else if (argument == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (argument == "--output-format" && hasValue) {
+            const std::string format = argv[++i];
+            options.outputFormat = format == "jsonl" ? OutputFormat::JsonLines : OutputFormat::Pretty;
+            validArguments = format == "pretty" || format == "jsonl";
+        }
+        else if (argument == "--output-chunks" && hasValue) {
+            options.outputChunks = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else {
+            validArguments = false;
+        }
+    }
+    validArguments = validArguments && (options.logPath.empty() || options.replayPath.empty());
+    // The usage rollup is not in a snapshot, so it cannot be resumed
+    validArguments = validArguments && (options.usagePath.empty() || !options.resume);
+    if (!options.usagePath.empty() && options.usageBucketSeconds == 0) {
+        options.usageBucketSeconds = 86400;
+    }
+    if (!validArguments || ((options.checkpointInterval != 0 || options.resume) && options.snapshotPath.empty())) {
+        std::cerr << "Usage: " << argv[0] << " <input.json> [--threads N] [--snapshot <file> [--checkpoint N] [--resume]]"
+            << " [--wal <file> [--group-commit N] [--group-micros T] | --replay <file>]"
+            << " [--events text|jsonl|binary|none] [--events-file <file>] [--usage-bucket S] [--usage <file>]"
+            << " [--output <file>] [--output-format pretty|jsonl] [--output-chunks N]" << std::endl;
+        return 1;
+    }
+    // The ShardedExecutor reports no events; an asked-for stream would stay empty
+    if (options.threads > 1 && options.events) {
+        if (eventsRequested) {
+            std::cerr << "Error: Events are not reported with more than one thread; use --threads 1 or --events none." << std::endl;
+            return 1;
+        }
+        options.events = false;
+    }
+
+    const std::string inputFilename = argv[1];
+
+    BillingStore store;
+
+    // Actions are streamed from the input and applied as they are read
+    bool ok = readInputFromJSON(inputFilename, store, options);
+
+    ok = writeOutputToJSON(options.outputPath, store, options.outputFormat, options.outputChunks) && ok;
+
+    if (!options.usagePath.empty()) {
+        ok = writeUsageToJSON(options.usagePath, store) && ok;
+    }
 
-    return 0;
+    return ok ? 0 : 1;
 }
+#endif
@@ -2,220 +2,2766 @@
 #include <vector>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
+#include <typeinfo>
+#include <unordered_map>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <cstdint>
+#include <queue>
+#include <list>
+#include <deque>
+#include <limits>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
 #include <nlohmann/json.hpp>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using json = nlohmann::json;
 
+// Distances in km between points given in degrees
+namespace GeoDistance {
+    const double Pi = 3.14159265358979323846;
+    const double EarthRadius = 6371.0088; // Mean radius
+    const double ToRadians = Pi / 180.0;
+
+    // Great circle on a sphere
+    inline double haversine(double latitude1, double longitude1, double latitude2, double longitude2) {
+        double sinLatitude = std::sin((latitude2 - latitude1) * ToRadians / 2);
+        double sinLongitude = std::sin((longitude2 - longitude1) * ToRadians / 2);
+        double a = sinLatitude * sinLatitude
+            + std::cos(latitude1 * ToRadians) * std::cos(latitude2 * ToRadians) * sinLongitude * sinLongitude;
+        return 2 * EarthRadius * std::asin(std::min(1.0, std::sqrt(a)));
+    }
+
+    // Geodesic on the WGS-84 ellipsoid (Vincenty's inverse formula). Falls
+    // back to haversine for nearly antipodal points, where it does not converge.
+    inline double vincenty(double latitude1, double longitude1, double latitude2, double longitude2) {
+        const double a = 6378.137;
+        const double f = 1 / 298.257223563;
+        const double b = (1 - f) * a;
+        const double L = (longitude2 - longitude1) * ToRadians;
+        const double U1 = std::atan((1 - f) * std::tan(latitude1 * ToRadians));
+        const double U2 = std::atan((1 - f) * std::tan(latitude2 * ToRadians));
+        const double sinU1 = std::sin(U1), cosU1 = std::cos(U1);
+        const double sinU2 = std::sin(U2), cosU2 = std::cos(U2);
+
+        double lambda = L;
+        for (int iteration = 0; iteration < 200; ++iteration) {
+            double sinLambda = std::sin(lambda), cosLambda = std::cos(lambda);
+            double sinSigma = std::sqrt((cosU2 * sinLambda) * (cosU2 * sinLambda)
+                + (cosU1 * sinU2 - sinU1 * cosU2 * cosLambda) * (cosU1 * sinU2 - sinU1 * cosU2 * cosLambda));
+            if (sinSigma == 0) {
+                return 0.0; // Same point
+            }
+            double cosSigma = sinU1 * sinU2 + cosU1 * cosU2 * cosLambda;
+            double sigma = std::atan2(sinSigma, cosSigma);
+            double sinAlpha = cosU1 * cosU2 * sinLambda / sinSigma;
+            double cosSqAlpha = 1 - sinAlpha * sinAlpha;
+            double cos2SigmaM = cosSqAlpha != 0 ? cosSigma - 2 * sinU1 * sinU2 / cosSqAlpha : 0.0; // Equatorial line
+            double C = f / 16 * cosSqAlpha * (4 + f * (4 - 3 * cosSqAlpha));
+            double previous = lambda;
+            lambda = L + (1 - C) * f * sinAlpha * (sigma + C * sinSigma * (cos2SigmaM + C * cosSigma * (-1 + 2 * cos2SigmaM * cos2SigmaM)));
+            if (std::abs(lambda - previous) < 1e-12) {
+                double uSq = cosSqAlpha * (a * a - b * b) / (b * b);
+                double A = 1 + uSq / 16384 * (4096 + uSq * (-768 + uSq * (320 - 175 * uSq)));
+                double B = uSq / 1024 * (256 + uSq * (-128 + uSq * (74 - 47 * uSq)));
+                double deltaSigma = B * sinSigma * (cos2SigmaM + B / 4 * (cosSigma * (-1 + 2 * cos2SigmaM * cos2SigmaM)
+                    - B / 6 * cos2SigmaM * (-3 + 4 * sinSigma * sinSigma) * (-3 + 4 * cos2SigmaM * cos2SigmaM)));
+                return b * A * (sigma - deltaSigma);
+            }
+        }
+        return haversine(latitude1, longitude1, latitude2, longitude2);
+    }
+}
+
+// Concrete container types. Fuel per km is a rate per unit of weight;
+// every rate is a multiple of 0.5, so it is also kept as an integer number
+// of halves for exact integer sums
+enum class ContainerKind : uint8_t {
+    Basic,
+    Refrigerated,
+    Liquid
+};
+
+inline int consumptionHalves(ContainerKind kind) {
+    switch (kind) {
+    case ContainerKind::Basic: return 5;
+    case ContainerKind::Refrigerated: return 10;
+    case ContainerKind::Liquid: return 8;
+    }
+    return 0;
+}
+
+inline double consumptionRate(ContainerKind kind) {
+    return 0.5 * consumptionHalves(kind);
+}
+
 class Container {
 public:
     Container(int id, int weight) : ID(id), weight(weight) {}
+    virtual ~Container() = default;
+
+    virtual double consumption() const = 0;
+    virtual ContainerKind getKind() const = 0;
+
+    bool equals(const Container& other) const {
+        return (typeid(*this) == typeid(other)) && (ID == other.ID) && (weight == other.weight);
+    }
+
+    int getID() const { return ID; }
+    int getWeight() const { return weight; }
+
+private:
+    int ID;
+    int weight;
+};
+
+class BasicContainer : public Container {
+public:
+    BasicContainer(int id, int weight) : Container(id, weight) {}
+
+    double consumption() const override {
+        return consumptionRate(ContainerKind::Basic) * getWeight();
+    }
+
+    ContainerKind getKind() const override { return ContainerKind::Basic; }
+};
+
+class HeavyContainer : public Container {
+public:
+    HeavyContainer(int id, int weight) : Container(id, weight) {}
+
+    double consumption() const override = 0;  // Pure virtual function
+};
+
+class RefrigeratedContainer : public HeavyContainer {
+public:
+    RefrigeratedContainer(int id, int weight) : HeavyContainer(id, weight) {}
+
+    double consumption() const override {
+        return consumptionRate(ContainerKind::Refrigerated) * getWeight();
+    }
+
+    ContainerKind getKind() const override { return ContainerKind::Refrigerated; }
+};
+
+class LiquidContainer : public HeavyContainer {
+public:
+    LiquidContainer(int id, int weight) : HeavyContainer(id, weight) {}
+
+    double consumption() const override {
+        return consumptionRate(ContainerKind::Liquid) * getWeight();
+    }
+
+    ContainerKind getKind() const override { return ContainerKind::Liquid; }
+};
+
+// Compact form of a container: no vtable and no separate allocation
+struct PackedContainer {
+    int ID;
+    int weight;
+    ContainerKind kind;
+
+    static PackedContainer of(const Container& cont) {
+        return { cont.getID(), cont.getWeight(), cont.getKind() };
+    }
+
+    double consumption() const {
+        return consumptionRate(kind) * weight;
+    }
+
+    // Back to the class hierarchy, for code that works with Container*
+    std::unique_ptr<Container> unpack() const {
+        switch (kind) {
+        case ContainerKind::Refrigerated: return std::unique_ptr<Container>(new RefrigeratedContainer(ID, weight));
+        case ContainerKind::Liquid: return std::unique_ptr<Container>(new LiquidContainer(ID, weight));
+        default: return std::unique_ptr<Container>(new BasicContainer(ID, weight));
+        }
+    }
+};
+
+// Many containers, e.g. a whole fleet's cargo, stored as parallel arrays of
+// IDs, weights and kinds. Summing fuel per km over them reads two contiguous
+// arrays and adds exact integer halves, so the loop vectorizes and the total
+// does not depend on the order of the containers.
+class PackedContainers {
+public:
+    size_t size() const { return weights.size(); }
+    bool empty() const { return weights.empty(); }
+
+    void reserve(size_t count) {
+        ids.reserve(count);
+        weights.reserve(count);
+        kinds.reserve(count);
+    }
+
+    void push_back(const PackedContainer& cont) {
+        ids.push_back(cont.ID);
+        weights.push_back(cont.weight);
+        kinds.push_back(cont.kind);
+    }
+
+    void push_back(const Container& cont) {
+        push_back(PackedContainer::of(cont));
+    }
+
+    PackedContainer operator[](size_t i) const {
+        return { ids[i], weights[i], kinds[i] };
+    }
+
+    void clear() {
+        ids.clear();
+        weights.clear();
+        kinds.clear();
+    }
+
+    // Fuel per km of all the containers
+    double consumption() const {
+        return consumption(kinds.data(), weights.data(), weights.size());
+    }
+
+    static double consumption(const ContainerKind* kinds, const int* weights, size_t count) {
+        // Sum the weights per kind with selects rather than branches, then
+        // apply consumptionHalves once: every weight at the basic rate plus
+        // the extra of the refrigerated and liquid rates
+        int64_t all = 0;
+        int64_t refrigerated = 0;
+        int64_t liquid = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int64_t weight = weights[i];
+            all += weight;
+            refrigerated += kinds[i] == ContainerKind::Refrigerated ? weight : 0;
+            liquid += kinds[i] == ContainerKind::Liquid ? weight : 0;
+        }
+        int64_t basicHalves = consumptionHalves(ContainerKind::Basic);
+        int64_t halves = basicHalves * all
+            + (consumptionHalves(ContainerKind::Refrigerated) - basicHalves) * refrigerated
+            + (consumptionHalves(ContainerKind::Liquid) - basicHalves) * liquid;
+        return 0.5 * static_cast<double>(halves);
+    }
+
+    const int* getIDs() const { return ids.data(); }
+    const int* getWeights() const { return weights.data(); }
+    const ContainerKind* getKinds() const { return kinds.data(); }
+
+private:
+    std::vector<int> ids;
+    std::vector<int> weights;
+    std::vector<ContainerKind> kinds;
+};
+
+// Containers held by a ship or a port, keyed by container ID. The containers
+// are kept densely in a vector and an ID index points into it, so finding,
+// adding and removing a container are O(1); removal moves the last
+// container into the freed slot, so the order is not preserved.
+class ContainerSlotMap {
+public:
+    size_t size() const { return containers.size(); }
+    bool empty() const { return containers.empty(); }
+
+    void reserve(size_t count) {
+        containers.reserve(count);
+        slots.reserve(count);
+    }
+
+    // False if a container with the same ID is already held
+    bool insert(Container* cont) {
+        if (!slots.emplace(cont->getID(), containers.size()).second) {
+            return false;
+        }
+        containers.push_back(cont);
+        return true;
+    }
+
+    // The held container with the ID of cont, or null
+    Container* find(const Container& cont) const {
+        auto it = slots.find(cont.getID());
+        if (it == slots.end()) {
+            return nullptr;
+        }
+        Container* held = containers[it->second];
+        // The same object needs no type comparison
+        return held == &cont || held->equals(cont) ? held : nullptr;
+    }
+
+    bool erase(const Container& cont) {
+        auto it = slots.find(cont.getID());
+        if (it == slots.end()) {
+            return false;
+        }
+        size_t slot = it->second;
+        Container* held = containers[slot];
+        if (held != &cont && !held->equals(cont)) {
+            return false;
+        }
+        slots.erase(it);
+        if (slot + 1 != containers.size()) {
+            containers[slot] = containers.back();
+            slots[containers[slot]->getID()] = slot;
+        }
+        containers.pop_back();
+        return true;
+    }
+
+    std::vector<Container*>::const_iterator begin() const { return containers.begin(); }
+    std::vector<Container*>::const_iterator end() const { return containers.end(); }
+
+private:
+    std::vector<Container*> containers;
+    std::unordered_map<int, size_t> slots;
+};
+
+// A whole file mapped read-only
+class MappedFile {
+private:
+    const char* base;
+    size_t length;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+public:
+    MappedFile() : base(nullptr), length(0) {
+#if defined(_WIN32)
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        base = mapping != nullptr ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        length = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        base = address != MAP_FAILED ? static_cast<const char*>(address) : nullptr;
+#endif
+        if (base == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (base != nullptr) {
+            UnmapViewOfFile(base);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base != nullptr) {
+            munmap(const_cast<char*>(base), length);
+        }
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// One departure: the ship, the ports it sails from and to, when, the fuel
+// for the leg and the weight of its cargo
+struct VoyageRecord {
+    int shipID;
+    int fromPortID;
+    int toPortID;
+    double time;
+    double fuel;
+    long long cargoWeight;
+};
+
+// ChunkSize voyages stored by column, so a scan reads only the columns it
+// needs
+struct VoyageChunk {
+    static const size_t ChunkSize = 4096;
+
+    int32_t shipIDs[ChunkSize];
+    int32_t fromPortIDs[ChunkSize];
+    int32_t toPortIDs[ChunkSize];
+    double times[ChunkSize];
+    double fuels[ChunkSize];
+    int64_t cargoWeights[ChunkSize];
+
+    VoyageRecord at(size_t i) const {
+        return { shipIDs[i], fromPortIDs[i], toPortIDs[i], times[i], fuels[i], cargoWeights[i] };
+    }
+};
+
+struct VoyageTotals {
+    uint64_t voyages = 0;
+    double fuel = 0.0;
+    long long cargoWeight = 0;
+};
+
+// Append-only log of voyages in chunks of VoyageChunk::ChunkSize records.
+// Every chunk keeps the range of its times, so a time-range scan skips the
+// chunks outside it without reading them. With a spill file, full chunks
+// beyond the newest maxChunksInMemory are appended to the file and freed;
+// scans read them through a read-only mapping of the file, so memory stays
+// bounded however long a simulation runs. Chunks are written as they are
+// laid out in memory, so a spill file is only read back by the same build.
+// Set the time with setTime before the events it stamps; a port with a log
+// records every departure from it. A scan may map the spill file, so scans
+// must not run concurrently with each other or with append.
+class VoyageLog {
+public:
+    VoyageLog() : spill(nullptr), maxChunksInMemory(std::numeric_limits<size_t>::max()), spilled(0), time(0.0) {}
+
+    VoyageLog(const VoyageLog&) = delete;
+    VoyageLog& operator=(const VoyageLog&) = delete;
+
+    ~VoyageLog() {
+        if (spill != nullptr) {
+            std::fclose(spill);
+        }
+    }
+
+    // Starts spilling to a new file at path; false if it cannot be created
+    // or the log already spills
+    bool spillTo(const std::string& path, size_t chunksInMemory) {
+        if (spill != nullptr) {
+            return false;
+        }
+        spill = std::fopen(path.c_str(), "wb");
+        if (spill == nullptr) {
+            return false;
+        }
+        spillPath = path;
+        maxChunksInMemory = std::max<size_t>(1, chunksInMemory);
+        spillFullChunks();
+        return true;
+    }
+
+    void append(const VoyageRecord& record) {
+        if (chunks.empty() || summaries.back().count == VoyageChunk::ChunkSize) {
+            chunks.emplace_back(new VoyageChunk);
+            summaries.push_back({ record.time, record.time, 0 });
+            spillFullChunks();
+        }
+        VoyageChunk& chunk = *chunks.back();
+        Summary& summary = summaries.back();
+        size_t i = summary.count++;
+        chunk.shipIDs[i] = record.shipID;
+        chunk.fromPortIDs[i] = record.fromPortID;
+        chunk.toPortIDs[i] = record.toPortID;
+        chunk.times[i] = record.time;
+        chunk.fuels[i] = record.fuel;
+        chunk.cargoWeights[i] = record.cargoWeight;
+        summary.minTime = std::min(summary.minTime, record.time);
+        summary.maxTime = std::max(summary.maxTime, record.time);
+    }
+
+    // Calls visit(chunk, count) for every chunk, oldest first, that may
+    // hold a record with begin <= time < end; count records of it are used
+    template <typename Visit>
+    void scanChunks(double begin, double end, Visit visit) const {
+        for (size_t i = 0; i < summaries.size(); ++i) {
+            const Summary& summary = summaries[i];
+            if (summary.maxTime < begin || summary.minTime >= end) {
+                continue;
+            }
+            const VoyageChunk* chunk = i < spilled ? spilledChunk(i) : chunks[i - spilled].get();
+            if (chunk != nullptr) {
+                visit(*chunk, static_cast<size_t>(summary.count));
+            }
+        }
+    }
+
+    // Calls visit(record) for every record with begin <= time < end, in
+    // the order they were appended
+    template <typename Visit>
+    void scan(double begin, double end, Visit visit) const {
+        scanChunks(begin, end, [&](const VoyageChunk& chunk, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (chunk.times[i] >= begin && chunk.times[i] < end) {
+                    visit(chunk.at(i));
+                }
+            }
+        });
+    }
+
+    // Voyages, fuel and cargo from a port, or from every port when portID
+    // is negative, with begin <= time < end
+    VoyageTotals totals(double begin, double end, int portID = -1) const {
+        VoyageTotals result;
+        scanChunks(begin, end, [&](const VoyageChunk& chunk, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                bool selected = chunk.times[i] >= begin && chunk.times[i] < end
+                    && (portID < 0 || chunk.fromPortIDs[i] == portID);
+                result.voyages += selected;
+                result.fuel += selected ? chunk.fuels[i] : 0.0;
+                result.cargoWeight += selected ? chunk.cargoWeights[i] : 0;
+            }
+        });
+        return result;
+    }
+
+    size_t size() const {
+        return summaries.empty() ? 0 : (summaries.size() - 1) * VoyageChunk::ChunkSize + summaries.back().count;
+    }
+
+    size_t getChunksInMemory() const { return chunks.size(); }
+    size_t getChunksSpilled() const { return spilled; }
+
+    void setTime(double now) { time = now; }
+    double getTime() const { return time; }
+
+private:
+    struct Summary {
+        double minTime;
+        double maxTime;
+        uint32_t count;
+    };
+
+    std::vector<Summary> summaries;                  // Of every chunk, oldest first
+    std::deque<std::unique_ptr<VoyageChunk>> chunks; // The newest ones, after the spilled ones
+    std::FILE* spill;
+    std::string spillPath;
+    size_t maxChunksInMemory;
+    size_t spilled;
+    double time;
+    mutable MappedFile mapped;
+    mutable size_t mappedChunks = 0;
+
+    // Only full chunks leave memory; the newest one may still be written to
+    void spillFullChunks() {
+        while (spill != nullptr && chunks.size() > maxChunksInMemory
+            && summaries[spilled].count == VoyageChunk::ChunkSize) {
+            if (std::fwrite(chunks.front().get(), sizeof(VoyageChunk), 1, spill) != 1) {
+                std::cerr << "Error: Unable to write the voyage log to " << spillPath << "." << std::endl;
+                std::fclose(spill);
+                spill = nullptr; // Keep the rest in memory
+                return;
+            }
+            chunks.pop_front();
+            ++spilled;
+        }
+    }
+
+    const VoyageChunk* spilledChunk(size_t i) const {
+        if (mappedChunks <= i) {
+            std::fflush(spill);
+            if (!mapped.open(spillPath)) {
+                std::cerr << "Error: Unable to map the voyage log " << spillPath << "." << std::endl;
+                mappedChunks = 0;
+                return nullptr;
+            }
+            mappedChunks = mapped.size() / sizeof(VoyageChunk);
+            if (mappedChunks <= i) {
+                return nullptr;
+            }
+        }
+        return reinterpret_cast<const VoyageChunk*>(mapped.data()) + i;
+    }
+};
+
+class IPort {
+public:
+    virtual void incomingShip(class Ship* s) = 0;
+    virtual void outgoingShip(class Ship* s) = 0;
+};
+
+class IShip {
+public:
+    virtual bool sailTo(class Port* p) = 0;
+    virtual void reFuel(double newFuel) = 0;
+    virtual bool load(Container* cont) = 0;
+    virtual bool unLoad(Container* cont) = 0;
+};
+
+// Ships at a port: those in a berth and those queued for one. Berthed ships
+// are kept densely in a vector with an index into it, as in
+// ContainerSlotMap, so arrival and departure are O(1) and removal moves the
+// last ship into the freed slot. When every berth is taken arriving ships
+// wait in arrival order, and a departure from a berth admits the first of
+// them. A ship that leaves while still waiting is forgotten at once, and
+// its queue entry is skipped when it reaches the front.
+class BerthRegistry {
+public:
+    static const size_t Unlimited = std::numeric_limits<size_t>::max();
+
+    enum class Status : uint8_t {
+        Absent,
+        Berthed,
+        Waiting
+    };
+
+    explicit BerthRegistry(size_t berths = Unlimited) : berths(berths), waiting(0), tickets(0) {}
+
+    // Berths the ship or queues it; a ship already here keeps its place
+    Status arrive(Ship* s) {
+        auto inserted = entries.emplace(s, Entry());
+        if (!inserted.second) {
+            return inserted.first->second.waiting ? Status::Waiting : Status::Berthed;
+        }
+        Entry& entry = inserted.first->second;
+        if (ships.size() < berths) {
+            entry.slot = ships.size();
+            ships.push_back(s);
+            return Status::Berthed;
+        }
+        entry.waiting = true;
+        entry.ticket = tickets++;
+        queue.push_back({ s, entry.ticket });
+        ++waiting;
+        return Status::Waiting;
+    }
+
+    // Removes the ship; returns the waiting ship berthed in its place, if any
+    Ship* depart(Ship* s) {
+        auto it = entries.find(s);
+        if (it == entries.end()) {
+            return nullptr;
+        }
+        if (it->second.waiting) {
+            entries.erase(it);
+            --waiting;
+            // Drop the entries of ships that left the queue once they
+            // outnumber the ships still in it
+            if (queue.size() > 2 * waiting + 64) {
+                compact();
+            }
+            return nullptr;
+        }
+        size_t slot = it->second.slot;
+        entries.erase(it);
+        if (slot + 1 != ships.size()) {
+            ships[slot] = ships.back();
+            entries[ships[slot]].slot = slot;
+        }
+        ships.pop_back();
+        return admit();
+    }
+
+    // Berths the first waiting ship if a berth is free; null otherwise
+    Ship* admit() {
+        while (!queue.empty() && ships.size() < berths) {
+            Waiter next = queue.front();
+            queue.pop_front();
+            auto it = entries.find(next.ship);
+            if (it == entries.end() || !it->second.waiting || it->second.ticket != next.ticket) {
+                continue;
+            }
+            it->second.waiting = false;
+            it->second.slot = ships.size();
+            ships.push_back(next.ship);
+            --waiting;
+            return next.ship;
+        }
+        return nullptr;
+    }
+
+    Status status(const Ship* s) const {
+        auto it = entries.find(s);
+        if (it == entries.end()) {
+            return Status::Absent;
+        }
+        return it->second.waiting ? Status::Waiting : Status::Berthed;
+    }
+
+    // Lowering the limit leaves berthed ships in place; raising it does not
+    // admit anyone until admit is called
+    void setBerths(size_t count) { berths = count; }
+    size_t getBerths() const { return berths; }
+    size_t size() const { return ships.size(); }
+    size_t getWaiting() const { return waiting; }
+
+    // Berthed ships, in no particular order
+    std::vector<Ship*>::const_iterator begin() const { return ships.begin(); }
+    std::vector<Ship*>::const_iterator end() const { return ships.end(); }
+
+    // Waiting ships in the order they will be berthed
+    template <typename Visit>
+    void forEachWaiting(Visit visit) const {
+        for (const Waiter& waiter : queue) {
+            auto it = entries.find(waiter.ship);
+            if (it != entries.end() && it->second.waiting && it->second.ticket == waiter.ticket) {
+                visit(waiter.ship);
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        size_t slot = 0;     // In ships, when berthed
+        uint64_t ticket = 0; // Of the queue entry, when waiting
+        bool waiting = false;
+    };
+
+    struct Waiter {
+        Ship* ship;
+        uint64_t ticket;
+    };
+
+    size_t berths;
+    size_t waiting;
+    uint64_t tickets;
+    std::vector<Ship*> ships;
+    std::unordered_map<const Ship*, Entry> entries;
+    std::deque<Waiter> queue;
+
+    void compact() {
+        std::deque<Waiter> live;
+        forEachWaiting([&](Ship* s) { live.push_back({ s, entries[s].ticket }); });
+        queue.swap(live);
+    }
+};
+
+// Told whenever a port gives a ship a berth, on arrival or from the queue
+class IBerthListener {
+public:
+    virtual void shipBerthed(class Port& p, class Ship& s) = 0;
+};
+
+class Port : public IPort {
+public:
+    Port(int ID, double latitude, double longitude)
+        : ID(ID), latitude(latitude), longitude(longitude), log(nullptr), listener(nullptr), departures(0) {}
+
+    // A ship arriving when every berth is taken waits for one
+    void incomingShip(Ship* s) override {
+        if (berths.arrive(s) == BerthRegistry::Status::Berthed && listener != nullptr) {
+            listener->shipBerthed(*this, *s);
+        }
+    }
+
+    void outgoingShip(Ship* s) override;
+
+    // Ships at a time in the port's berths; 0 lifts the limit. Raising it
+    // berths waiting ships
+    void setBerths(size_t count) {
+        berths.setBerths(count == 0 ? BerthRegistry::Unlimited : count);
+        while (Ship* admitted = berths.admit()) {
+            if (listener != nullptr) {
+                listener->shipBerthed(*this, *admitted);
+            }
+        }
+    }
+
+    void useListener(IBerthListener* berthListener) {
+        listener = berthListener;
+    }
+
+    // Departures are recorded in the log when one is set; otherwise only
+    // counted
+    void useLog(VoyageLog* voyages) {
+        log = voyages;
+    }
+
+    // Containers waiting in the port
+    bool storeContainer(Container* cont) {
+        return containers.insert(cont);
+    }
+
+    bool releaseContainer(Container* cont) {
+        return containers.erase(*cont);
+    }
+
+    // Great-circle distance in km
+    double getDistance(const Port& other) const {
+        return GeoDistance::haversine(latitude, longitude, other.latitude, other.longitude);
+    }
+
+    int getID() const { return ID; }
+    double getLatitude() const { return latitude; }
+    double getLongitude() const { return longitude; }
+    const ContainerSlotMap& getContainers() const { return containers; }
+    uint64_t getDepartures() const { return departures; }
+    const BerthRegistry& getBerths() const { return berths; }
+
+    void printPort() const;
+
+private:
+    int ID;
+    double latitude;
+    double longitude;
+    ContainerSlotMap containers;
+    VoyageLog* log;
+    IBerthListener* listener;
+    uint64_t departures;
+    BerthRegistry berths;
+};
+
+// Distances between all pairs of a set of ports, computed once and looked up
+// in O(1) by port ID. The matrix is stored as TileSize x TileSize tiles of
+// the upper triangle. Up to DenseLimit ports every tile is computed when the
+// matrix is built; for larger sets a tile is computed the first time it is
+// used, so only the parts of the matrix a route touches cost memory.
+// Lookups may come from several threads: a tile is published with a
+// compare-and-swap and a thread that loses the race discards its copy.
+// Haversine rows are computed over structure-of-arrays coordinates in a
+// branch-free loop the compiler can vectorize.
+class DistanceMatrix {
+public:
+    enum class Model {
+        Haversine,
+        Vincenty
+    };
+
+    static constexpr size_t TileSize = 64;
+    static constexpr size_t DenseLimit = 4096;
+
+    DistanceMatrix(const std::vector<const Port*>& ports, Model model = Model::Haversine)
+        : model(model), count(ports.size()), tilesPerSide((ports.size() + TileSize - 1) / TileSize),
+        tiles(new std::atomic<double*>[tilesPerSide * tilesPerSide]) {
+        for (size_t i = 0; i < count; ++i) {
+            indices.emplace(ports[i]->getID(), i);
+            latitudes.push_back(ports[i]->getLatitude());
+            longitudes.push_back(ports[i]->getLongitude());
+            latitudeRadians.push_back(ports[i]->getLatitude() * GeoDistance::ToRadians);
+            longitudeRadians.push_back(ports[i]->getLongitude() * GeoDistance::ToRadians);
+            cosLatitudes.push_back(std::cos(latitudeRadians.back()));
+        }
+        for (size_t i = 0; i < tilesPerSide * tilesPerSide; ++i) {
+            tiles[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if (count <= DenseLimit) {
+            for (size_t row = 0; row < tilesPerSide; ++row) {
+                for (size_t column = row; column < tilesPerSide; ++column) {
+                    tile(row, column);
+                }
+            }
+        }
+    }
+
+    DistanceMatrix(const DistanceMatrix&) = delete;
+    DistanceMatrix& operator=(const DistanceMatrix&) = delete;
+
+    ~DistanceMatrix() {
+        for (size_t i = 0; i < tilesPerSide * tilesPerSide; ++i) {
+            delete[] tiles[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // Index of a port, or -1 if it is not in the matrix
+    long long indexOf(int portID) const {
+        auto it = indices.find(portID);
+        return it != indices.end() ? static_cast<long long>(it->second) : -1;
+    }
+
+    // Distance by port index
+    double at(size_t from, size_t to) const {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        const double* cells = tile(from / TileSize, to / TileSize);
+        return cells[(from % TileSize) * TileSize + to % TileSize];
+    }
+
+    // Distance by port ID; NaN if a port is not in the matrix
+    double between(int fromID, int toID) const {
+        long long from = indexOf(fromID);
+        long long to = indexOf(toID);
+        if (from < 0 || to < 0) {
+            return std::nan("");
+        }
+        return at(static_cast<size_t>(from), static_cast<size_t>(to));
+    }
+
+    // Haversine distances from one point to count points, all in radians
+    static void haversineRow(double latitude, double longitude, double cosLatitude,
+        const double* latitudes, const double* longitudes, const double* cosLatitudes, double* distances, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            double sinLatitude = std::sin((latitudes[i] - latitude) * 0.5);
+            double sinLongitude = std::sin((longitudes[i] - longitude) * 0.5);
+            double a = sinLatitude * sinLatitude + cosLatitude * cosLatitudes[i] * sinLongitude * sinLongitude;
+            distances[i] = 2 * GeoDistance::EarthRadius * std::asin(std::sqrt(std::min(1.0, a)));
+        }
+    }
+
+private:
+    Model model;
+    size_t count;
+    size_t tilesPerSide;
+    std::unordered_map<int, size_t> indices;
+    std::vector<double> latitudes;
+    std::vector<double> longitudes;
+    std::vector<double> latitudeRadians;
+    std::vector<double> longitudeRadians;
+    std::vector<double> cosLatitudes;
+    std::unique_ptr<std::atomic<double*>[]> tiles;
+
+    // Tile of the upper triangle with row <= column
+    const double* tile(size_t row, size_t column) const {
+        std::atomic<double*>& slot = tiles[row * tilesPerSide + column];
+        double* cells = slot.load(std::memory_order_acquire);
+        if (cells != nullptr) {
+            return cells;
+        }
+        double* computed = computeTile(row, column);
+        if (slot.compare_exchange_strong(cells, computed, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return computed;
+        }
+        delete[] computed;
+        return cells;
+    }
+
+    double* computeTile(size_t row, size_t column) const {
+        double* cells = new double[TileSize * TileSize]();
+        size_t firstColumn = column * TileSize;
+        size_t width = std::min(TileSize, count - firstColumn);
+        for (size_t i = 0; i < TileSize && row * TileSize + i < count; ++i) {
+            size_t from = row * TileSize + i;
+            double* out = cells + i * TileSize;
+            if (model == Model::Haversine) {
+                haversineRow(latitudeRadians[from], longitudeRadians[from], cosLatitudes[from], latitudeRadians.data() + firstColumn,
+                    longitudeRadians.data() + firstColumn, cosLatitudes.data() + firstColumn, out, width);
+            }
+            else {
+                for (size_t j = 0; j < width; ++j) {
+                    out[j] = GeoDistance::vincenty(latitudes[from], longitudes[from], latitudes[firstColumn + j], longitudes[firstColumn + j]);
+                }
+            }
+        }
+        return cells;
+    }
+};
+
+// Ports by position, for the ports nearest a point or within a distance of
+// it. Positions are points on the unit sphere, where the straight-line
+// (chord) distance grows with the great-circle distance, so a k-d tree over
+// x, y and z answers both queries by visiting O(log n) of its nodes for
+// points spread over the globe. The tree is implicit: the ports are
+// reordered so every range's median is its node and each half its subtrees.
+// Queries only read the index, so batches are split over threads.
+class PortIndex {
+public:
+    struct Neighbour {
+        Port* port;
+        double distance; // km
+    };
+
+    struct Point {
+        double latitude;
+        double longitude;
+    };
+
+    explicit PortIndex(const std::vector<Port*>& ports) : ports(ports.size()), coordinates(ports.size() * 3), axes(ports.size()) {
+        std::vector<double> positions(ports.size() * 3);
+        std::vector<uint32_t> order(ports.size());
+        for (size_t i = 0; i < ports.size(); ++i) {
+            toUnit(ports[i]->getLatitude(), ports[i]->getLongitude(), &positions[i * 3]);
+            order[i] = static_cast<uint32_t>(i);
+        }
+        build(positions, order, 0, ports.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            this->ports[i] = ports[order[i]];
+            std::copy(&positions[order[i] * 3], &positions[order[i] * 3] + 3, &coordinates[i * 3]);
+        }
+    }
+
+    size_t size() const { return ports.size(); }
+
+    // Up to k ports, nearest first
+    std::vector<Neighbour> nearest(double latitude, double longitude, size_t k) const {
+        std::vector<Neighbour> result;
+        if (k == 0 || ports.empty()) {
+            return result;
+        }
+        double target[3];
+        toUnit(latitude, longitude, target);
+        std::priority_queue<std::pair<double, uint32_t>> best; // Farthest of the k on top
+        searchNearest(0, ports.size(), target, k, best);
+        result.resize(best.size());
+        for (size_t i = best.size(); i-- > 0; best.pop()) {
+            result[i] = { ports[best.top().second], toDistance(best.top().first) };
+        }
+        return result;
+    }
+
+    // Ports no farther than radius km, nearest first
+    std::vector<Neighbour> within(double latitude, double longitude, double radius) const {
+        std::vector<Neighbour> result;
+        if (radius < 0 || ports.empty()) {
+            return result;
+        }
+        double target[3];
+        toUnit(latitude, longitude, target);
+        // Chord of the radius; anything on the sphere is within half the circumference
+        double angle = radius / GeoDistance::EarthRadius;
+        double chord = angle >= GeoDistance::Pi ? 2.0 : 2.0 * std::sin(angle / 2);
+        std::vector<std::pair<double, uint32_t>> found;
+        searchWithin(0, ports.size(), target, chord * chord * (1 + 1e-12), found);
+        std::sort(found.begin(), found.end());
+        result.reserve(found.size());
+        for (const auto& entry : found) {
+            result.push_back({ ports[entry.second], toDistance(entry.first) });
+        }
+        return result;
+    }
+
+    std::vector<std::vector<Neighbour>> nearest(const std::vector<Point>& points, size_t k, unsigned threads = 1) const {
+        return batch(points, threads, [&](const Point& point) { return nearest(point.latitude, point.longitude, k); });
+    }
+
+    std::vector<std::vector<Neighbour>> within(const std::vector<Point>& points, double radius, unsigned threads = 1) const {
+        return batch(points, threads, [&](const Point& point) { return within(point.latitude, point.longitude, radius); });
+    }
+
+private:
+    std::vector<Port*> ports;        // In tree order
+    std::vector<double> coordinates; // x, y, z of every port
+    std::vector<uint8_t> axes;       // Splitting axis of the node at each index
+
+    static void toUnit(double latitude, double longitude, double* position) {
+        double phi = latitude * GeoDistance::ToRadians;
+        double lambda = longitude * GeoDistance::ToRadians;
+        position[0] = std::cos(phi) * std::cos(lambda);
+        position[1] = std::cos(phi) * std::sin(lambda);
+        position[2] = std::sin(phi);
+    }
+
+    static double toDistance(double squaredChord) {
+        return 2 * GeoDistance::EarthRadius * std::asin(std::min(1.0, std::sqrt(squaredChord) / 2));
+    }
+
+    double squaredChord(size_t i, const double* target) const {
+        const double* position = &coordinates[i * 3];
+        double dx = position[0] - target[0];
+        double dy = position[1] - target[1];
+        double dz = position[2] - target[2];
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Orders [begin, end) of the ports around the median of its widest axis
+    void build(const std::vector<double>& positions, std::vector<uint32_t>& order, size_t begin, size_t end) {
+        if (end - begin <= 1) {
+            return;
+        }
+        double low[3] = { 2, 2, 2 };
+        double high[3] = { -2, -2, -2 };
+        for (size_t i = begin; i < end; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = std::min(low[axis], positions[order[i] * 3 + axis]);
+                high[axis] = std::max(high[axis], positions[order[i] * 3 + axis]);
+            }
+        }
+        int axis = 0;
+        for (int candidate = 1; candidate < 3; ++candidate) {
+            if (high[candidate] - low[candidate] > high[axis] - low[axis]) {
+                axis = candidate;
+            }
+        }
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+            return positions[a * 3 + axis] < positions[b * 3 + axis];
+        });
+        axes[middle] = static_cast<uint8_t>(axis);
+        build(positions, order, begin, middle);
+        build(positions, order, middle + 1, end);
+    }
+
+    void searchNearest(size_t begin, size_t end, const double* target, size_t k,
+        std::priority_queue<std::pair<double, uint32_t>>& best) const {
+        if (begin >= end) {
+            return;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        double distance = squaredChord(middle, target);
+        if (best.size() < k) {
+            best.push({ distance, static_cast<uint32_t>(middle) });
+        }
+        else if (distance < best.top().first) {
+            best.pop();
+            best.push({ distance, static_cast<uint32_t>(middle) });
+        }
+        if (end - begin == 1) {
+            return;
+        }
+        int axis = axes[middle];
+        double offset = target[axis] - coordinates[middle * 3 + axis];
+        bool left = offset < 0;
+        searchNearest(left ? begin : middle + 1, left ? middle : end, target, k, best);
+        if (best.size() < k || offset * offset < best.top().first) {
+            searchNearest(left ? middle + 1 : begin, left ? end : middle, target, k, best);
+        }
+    }
+
+    void searchWithin(size_t begin, size_t end, const double* target, double limit,
+        std::vector<std::pair<double, uint32_t>>& found) const {
+        if (begin >= end) {
+            return;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        double distance = squaredChord(middle, target);
+        if (distance <= limit) {
+            found.push_back({ distance, static_cast<uint32_t>(middle) });
+        }
+        if (end - begin == 1) {
+            return;
+        }
+        int axis = axes[middle];
+        double offset = target[axis] - coordinates[middle * 3 + axis];
+        if (offset < 0 || offset * offset <= limit) {
+            searchWithin(begin, middle, target, limit, found);
+        }
+        if (offset >= 0 || offset * offset <= limit) {
+            searchWithin(middle + 1, end, target, limit, found);
+        }
+    }
+
+    template <typename Query>
+    static std::vector<std::vector<Neighbour>> batch(const std::vector<Point>& points, unsigned threads, Query query) {
+        std::vector<std::vector<Neighbour>> results(points.size());
+        threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, points.size())));
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                results[i] = query(points[i]);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back(run, points.size() * i / threads, points.size() * (i + 1) / threads);
+        }
+        run(0, points.size() / threads);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        return results;
+    }
+};
+
+// Shortest routes between ports along a graph of sea routes. Legs are
+// great-circle distances, and a ship's fuel for a route is its consumption
+// rate times the route's length, since the rate does not change at sea; so
+// the route that costs the least fuel is the shortest one for every ship
+// and one cache serves them all. Searches are A*. The great-circle distance
+// to the destination alone prunes little on graphs with long hub routes, so
+// the first search after the graph changes also picks landmarkCount ports
+// spread far apart and finds the route lengths from each of them to every
+// port. The difference of two ports' lengths from a landmark is a lower
+// bound on the route between them (ALT), and the heuristic is the largest
+// of these bounds and the great-circle distance. Found routes, and the
+// absence of one, are kept in a least-recently-used cache of cacheSize
+// pairs; adding a port or a route clears it. A planner reuses its search
+// arrays between queries, so a thread should have its own.
+class RoutePlanner {
+public:
+    struct Route {
+        std::vector<Port*> stops; // From the start to the destination; empty if there is no route
+        std::vector<double> legs; // legs[i] is the length from stops[i] to stops[i + 1]
+        double distance = 0.0;
+
+        bool found() const { return !stops.empty(); }
+    };
+
+    explicit RoutePlanner(size_t cacheSize = 65536, size_t landmarkCount = 16)
+        : cacheSize(cacheSize), landmarkCount(landmarkCount) {}
+
+    // False if a port with the same ID exists
+    bool addPort(Port* port) {
+        if (!indices.emplace(port->getID(), ports.size()).second) {
+            return false;
+        }
+        ports.push_back(port);
+        latitudes.push_back(port->getLatitude() * GeoDistance::ToRadians);
+        longitudes.push_back(port->getLongitude() * GeoDistance::ToRadians);
+        cosLatitudes.push_back(std::cos(latitudes.back()));
+        edges.emplace_back();
+        distances.push_back(0.0);
+        estimates.push_back(0.0);
+        parents.push_back(0);
+        parentLegs.push_back(0.0);
+        epochs.push_back(0);
+        clearCache();
+        prepared = false;
+        return true;
+    }
+
+    // Ships may sail both ways along a route
+    bool addRoute(int fromID, int toID) {
+        auto from = indices.find(fromID);
+        auto to = indices.find(toID);
+        if (from == indices.end() || to == indices.end() || from->second == to->second) {
+            return false;
+        }
+        double length = ports[from->second]->getDistance(*ports[to->second]);
+        edges[from->second].push_back({ static_cast<uint32_t>(to->second), length });
+        edges[to->second].push_back({ static_cast<uint32_t>(from->second), length });
+        clearCache();
+        prepared = false;
+        return true;
+    }
+
+    Route find(int fromID, int toID) {
+        auto from = indices.find(fromID);
+        auto to = indices.find(toID);
+        if (from == indices.end() || to == indices.end()) {
+            return Route();
+        }
+        uint64_t key = (static_cast<uint64_t>(from->second) << 32) | static_cast<uint64_t>(to->second);
+        auto cached = cache.find(key);
+        if (cached != cache.end()) {
+            ++hits;
+            recent.splice(recent.begin(), recent, cached->second);
+            return toRoute(cached->second->second);
+        }
+        ++misses;
+        if (!prepared) {
+            prepare();
+        }
+        Path path = search(static_cast<uint32_t>(from->second), static_cast<uint32_t>(to->second));
+        Route route = toRoute(path);
+        if (cacheSize != 0) {
+            if (cache.size() == cacheSize) {
+                cache.erase(recent.back().first);
+                recent.pop_back();
+            }
+            recent.emplace_front(key, std::move(path));
+            cache.emplace(key, recent.begin());
+        }
+        return route;
+    }
+
+    // Fuel the ship needs for the route as it is loaded now, summed leg by
+    // leg as Ship::sailVia burns it
+    static double fuelFor(const Route& route, const Ship& ship);
+
+    void clearCache() {
+        cache.clear();
+        recent.clear();
+    }
+
+    size_t size() const { return ports.size(); }
+    uint64_t getCacheHits() const { return hits; }
+    uint64_t getCacheMisses() const { return misses; }
+
+private:
+    struct Edge {
+        uint32_t to;
+        double length;
+    };
+
+    struct Path {
+        std::vector<uint32_t> stops;
+        std::vector<double> legs;
+        double distance = 0.0;
+    };
+
+    typedef std::pair<uint64_t, Path> CacheEntry;
+
+    size_t cacheSize;
+    size_t landmarkCount;
+    std::vector<Port*> ports;
+    std::unordered_map<int, size_t> indices;
+    std::vector<double> latitudes; // Radians
+    std::vector<double> longitudes;
+    std::vector<double> cosLatitudes;
+    std::vector<std::vector<Edge>> edges;
+    std::list<CacheEntry> recent; // Most recently used first
+    std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> cache;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    // Route lengths from each landmark, landmarks consecutive per port;
+    // infinite where a port cannot be reached
+    std::vector<double> landmarkDistances;
+    size_t landmarks = 0;
+    bool prepared = false;
+
+    // Search state by port index; an entry is current only when its epoch
+    // is the search's, so nothing is cleared between searches
+    std::vector<double> distances;
+    std::vector<double> estimates; // Heuristic to the destination
+    std::vector<uint32_t> parents;
+    std::vector<double> parentLegs; // Length of the edge from the parent
+    std::vector<uint32_t> epochs;
+    uint32_t epoch = 0;
+
+    Route toRoute(const Path& path) const {
+        Route route;
+        route.distance = path.distance;
+        route.legs = path.legs;
+        route.stops.reserve(path.stops.size());
+        for (uint32_t stop : path.stops) {
+            route.stops.push_back(ports[stop]);
+        }
+        return route;
+    }
+
+    double remaining(uint32_t from, uint32_t to) const {
+        double sinLatitude = std::sin((latitudes[to] - latitudes[from]) * 0.5);
+        double sinLongitude = std::sin((longitudes[to] - longitudes[from]) * 0.5);
+        double a = sinLatitude * sinLatitude + cosLatitudes[from] * cosLatitudes[to] * sinLongitude * sinLongitude;
+        double bound = 2 * GeoDistance::EarthRadius * std::asin(std::sqrt(std::min(1.0, a)));
+        const double* fromLandmarks = landmarkDistances.data() + from * landmarks;
+        const double* toLandmarks = landmarkDistances.data() + to * landmarks;
+        for (size_t i = 0; i < landmarks; ++i) {
+            if (fromLandmarks[i] != HUGE_VAL && toLandmarks[i] != HUGE_VAL) {
+                bound = std::max(bound, std::abs(toLandmarks[i] - fromLandmarks[i]));
+            }
+        }
+        // Shaved so rounding cannot make it overestimate a route
+        return bound * (1 - 1e-9);
+    }
+
+    // Route lengths from source to every port
+    void lengthsFrom(uint32_t source, std::vector<double>& lengths) const {
+        lengths.assign(ports.size(), HUGE_VAL);
+        typedef std::pair<double, uint32_t> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        lengths[source] = 0.0;
+        open.push({ 0.0, source });
+        while (!open.empty()) {
+            Entry entry = open.top();
+            open.pop();
+            if (entry.first > lengths[entry.second]) {
+                continue;
+            }
+            for (const Edge& edge : edges[entry.second]) {
+                double length = entry.first + edge.length;
+                if (length < lengths[edge.to]) {
+                    lengths[edge.to] = length;
+                    open.push({ length, edge.to });
+                }
+            }
+        }
+    }
+
+    // Landmarks by farthest-point selection: each is the port farthest by
+    // route from the ones chosen so far, and ports in another part of the
+    // graph count as farthest
+    void prepare() {
+        landmarks = std::min(landmarkCount, ports.size());
+        landmarkDistances.assign(ports.size() * landmarks, HUGE_VAL);
+        std::vector<double> nearest(ports.size(), HUGE_VAL);
+        std::vector<double> lengths;
+        if (landmarks != 0) {
+            // Start from the port farthest from port 0
+            lengthsFrom(0, lengths);
+            uint32_t landmark = 0;
+            for (size_t i = 0; i < lengths.size(); ++i) {
+                if (lengths[i] != HUGE_VAL && lengths[i] > lengths[landmark]) {
+                    landmark = static_cast<uint32_t>(i);
+                }
+            }
+            for (size_t chosen = 0; chosen < landmarks; ++chosen) {
+                lengthsFrom(landmark, lengths);
+                for (size_t i = 0; i < ports.size(); ++i) {
+                    landmarkDistances[i * landmarks + chosen] = lengths[i];
+                    nearest[i] = std::min(nearest[i], lengths[i]);
+                }
+                landmark = static_cast<uint32_t>(std::max_element(nearest.begin(), nearest.end()) - nearest.begin());
+            }
+        }
+        prepared = true;
+    }
+
+    Path search(uint32_t from, uint32_t to) {
+        if (++epoch == 0) {
+            std::fill(epochs.begin(), epochs.end(), 0);
+            epoch = 1;
+        }
+        typedef std::pair<double, uint32_t> Entry; // Estimated total, port
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        distances[from] = 0.0;
+        estimates[from] = remaining(from, to);
+        parents[from] = from;
+        epochs[from] = epoch;
+        open.push({ estimates[from], from });
+        while (!open.empty()) {
+            Entry entry = open.top();
+            open.pop();
+            uint32_t port = entry.second;
+            if (port == to) {
+                break;
+            }
+            // Skip entries made stale by a shorter way to the port
+            if (entry.first > distances[port] + estimates[port]) {
+                continue;
+            }
+            for (const Edge& edge : edges[port]) {
+                double distance = distances[port] + edge.length;
+                bool reached = epochs[edge.to] == epoch;
+                if (!reached || distance < distances[edge.to]) {
+                    if (!reached) {
+                        epochs[edge.to] = epoch;
+                        estimates[edge.to] = remaining(edge.to, to);
+                    }
+                    distances[edge.to] = distance;
+                    parents[edge.to] = port;
+                    parentLegs[edge.to] = edge.length;
+                    open.push({ distance + estimates[edge.to], edge.to });
+                }
+            }
+        }
+
+        Path path;
+        if (epochs[to] != epoch) {
+            return path;
+        }
+        path.distance = distances[to];
+        for (uint32_t port = to; ; port = parents[port]) {
+            path.stops.push_back(port);
+            if (port == from) {
+                break;
+            }
+            path.legs.push_back(parentLegs[port]);
+        }
+        std::reverse(path.stops.begin(), path.stops.end());
+        std::reverse(path.legs.begin(), path.legs.end());
+        return path;
+    }
+};
+
+class Ship : public IShip {
+public:
+    Ship(int portID, int totalWeightCapacity, int maxNumAllContainers,
+        int maxNumHeavyContainers, int maxNumRefrigeratedContainers,
+        int maxNumLiquidContainers, double fuelConsumptionPerKM)
+        : ID(GenerateUniqueShipID()), fuel(0.0), currentPort(portID), port(nullptr), destinationPort(-1), legFuel(0.0),
+        distances(nullptr), totalWeightCapacity(totalWeightCapacity),
+        maxNumAllContainers(maxNumAllContainers), maxNumHeavyContainers(maxNumHeavyContainers),
+        maxNumRefrigeratedContainers(maxNumRefrigeratedContainers),
+        maxNumLiquidContainers(maxNumLiquidContainers), fuelConsumptionPerKM(fuelConsumptionPerKM) {}
+
+    // Distances come from the matrix when one is set, otherwise from the
+    // coordinates of the port the ship last sailed to
+    void useDistances(const DistanceMatrix* matrix) {
+        distances = matrix;
+    }
+
+    bool sailTo(Port* p) override {
+        if (depart(p)) {
+            arrive(p);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    // The two halves of sailTo, for when time passes at sea. depart burns
+    // the fuel for the leg and leaves the current port; the ship keeps the
+    // ID of the port it left until it arrives. A ship whose distance to the
+    // destination is unknown does not sail
+    bool depart(Port* destination) {
+        return depart(destination, distanceTo(*destination));
+    }
+
+    // Departs for a leg of known length, such as one of a planned route
+    bool depart(Port* destination, double distance) {
+        double requiredFuel = CalculateRequiredFuel(distance);
+        if (!std::isnan(requiredFuel) && fuel >= requiredFuel) {
+            // Consume fuel
+            fuel -= requiredFuel;
+            destinationPort = destination->getID();
+            legFuel = requiredFuel;
+            if (port != nullptr) {
+                port->outgoingShip(this);
+            }
+            port = nullptr;
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    // The ship is in the port from here on, berthed or waiting for a berth
+    void arrive(Port* p) {
+        // Update ship's position
+        port = p;
+        currentPort = p->getID();
+        p->incomingShip(this);
+    }
+
+    // Sails to destination along the planner's cheapest route, port by port.
+    // Every leg is charged by its length on the route, as fuelFor counts it.
+    // With refuel set the ship takes on fuel at a stop whenever it has too
+    // little for the next leg; otherwise it sets off only with fuel for the
+    // whole route. refuelStops receives the number of stops it refuelled at
+    bool sailVia(RoutePlanner& planner, Port* destination, bool refuel = true, int* refuelStops = nullptr) {
+        RoutePlanner::Route route = planner.find(currentPort, destination->getID());
+        if (!route.found() || (!refuel && fuel < RoutePlanner::fuelFor(route, *this))) {
+            return false;
+        }
+        int stops = 0;
+        for (size_t i = 1; i < route.stops.size(); ++i) {
+            double requiredFuel = CalculateRequiredFuel(route.legs[i - 1]);
+            if (refuel && fuel < requiredFuel) {
+                reFuel(requiredFuel - fuel);
+                ++stops;
+            }
+            // Rounding; without refuelling the whole route was paid for above
+            fuel = std::max(fuel, requiredFuel);
+            if (!depart(route.stops[i], route.legs[i - 1])) {
+                break;
+            }
+            arrive(route.stops[i]);
+        }
+        if (refuelStops != nullptr) {
+            *refuelStops = stops;
+        }
+        return currentPort == destination->getID();
+    }
+
+    void reFuel(double newFuel) override {
+        fuel += newFuel;
+    }
+
+    bool load(Container* cont) override {
+        // Check if the ship has enough capacity; a container with the same ID
+        // cannot be on board twice
+        Load added = Load::of(*cont);
+        if (!canLoad(added) || !containers.insert(cont)) {
+            return false;
+        }
+        totals.add(added);
+        return true;
+    }
+
+    bool unLoad(Container* cont) override {
+        // Find the container in the ship by its ID and remove it. The totals
+        // are taken from the container on board, which may be a different
+        // object than cont
+        Container* held = containers.find(*cont);
+        if (held == nullptr) {
+            return false;
+        }
+        containers.erase(*held);
+        totals.remove(Load::of(*held));
+        if (containers.empty()) {
+            totals = Load(); // Drop any rounding left in the consumption sum
+        }
+        return true;
+    }
+
+    // Whether cont fits within every capacity limit, in O(1)
+    bool canLoad(const Container& cont) const {
+        return canLoad(Load::of(cont));
+    }
+
+    void printContainers() const {
+        for (const auto& cont : containers) {
+            std::cout << "  Container ID: " << cont->getID() << " Weight: " << cont->getWeight() << std::endl;
+        }
+    }
+
+    int getID() const { return ID; }
+    double getFuel() const { return fuel; }
+    int getPortID() const { return currentPort; }
+    int getDestinationID() const { return destinationPort; }
+    double getLegFuel() const { return legFuel; }
+    int getTotalWeightCapacity() const { return totalWeightCapacity; }
+    int getMaxNumAllContainers() const { return maxNumAllContainers; }
+    int getMaxNumHeavyContainers() const { return maxNumHeavyContainers; }
+    int getMaxNumRefrigeratedContainers() const { return maxNumRefrigeratedContainers; }
+    int getMaxNumLiquidContainers() const { return maxNumLiquidContainers; }
+    const ContainerSlotMap& getContainers() const { return containers; }
+
+    // Distance in km from the current port. NaN if it is unknown: the
+    // matrix does not hold both ports and the ship has not arrived at a Port
+    // whose coordinates it could use, as with a newly built ship
+    double distanceTo(const Port& destination) const {
+        if (distances != nullptr) {
+            double distance = distances->between(currentPort, destination.getID());
+            if (!std::isnan(distance)) {
+                return distance;
+            }
+        }
+        return port != nullptr ? port->getDistance(destination) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double CalculateRequiredFuel(const Port& destination) const {
+        return CalculateRequiredFuel(distanceTo(destination));
+    }
+
+    double CalculateRequiredFuel(double distance) const {
+        // Calculate fuel required based on ship's consumption and containers
+        return getConsumptionRate() * distance;
+    }
+
+    // Fuel per km of the ship with its containers
+    double getConsumptionRate() const { return fuelConsumptionPerKM + totals.consumption; }
+    long long getTotalWeight() const { return totals.weight; }
+    size_t getNumAllContainers() const { return containers.size(); }
+    int getNumHeavyContainers() const { return totals.heavy; }
+    int getNumRefrigeratedContainers() const { return totals.refrigerated; }
+    int getNumLiquidContainers() const { return totals.liquid; }
+
+private:
+    // Running totals of the containers on board, kept up to date by load
+    // and unLoad so capacity checks and fuel need no pass over containers
+    struct Load {
+        long long weight = 0;
+        int heavy = 0;
+        int refrigerated = 0;
+        int liquid = 0;
+        double consumption = 0.0;
+
+        // The contribution of a single container
+        static Load of(const Container& cont) {
+            Load load;
+            load.weight = cont.getWeight();
+            ContainerKind kind = cont.getKind();
+            load.refrigerated = kind == ContainerKind::Refrigerated;
+            load.liquid = kind == ContainerKind::Liquid;
+            load.heavy = load.refrigerated + load.liquid;
+            load.consumption = cont.consumption();
+            return load;
+        }
+
+        void add(const Load& other) {
+            weight += other.weight;
+            heavy += other.heavy;
+            refrigerated += other.refrigerated;
+            liquid += other.liquid;
+            consumption += other.consumption;
+        }
 
-    virtual double consumption() const = 0;
+        void remove(const Load& other) {
+            weight -= other.weight;
+            heavy -= other.heavy;
+            refrigerated -= other.refrigerated;
+            liquid -= other.liquid;
+            consumption -= other.consumption;
+        }
+    };
 
-    bool equals(const Container& other) const {
-        return (typeid(*this) == typeid(other)) && (ID == other.ID) && (weight == other.weight);
+    bool canLoad(const Load& added) const {
+        return containers.size() < static_cast<size_t>(maxNumAllContainers)
+            && totals.weight + added.weight <= totalWeightCapacity
+            && totals.heavy + added.heavy <= maxNumHeavyContainers
+            && totals.refrigerated + added.refrigerated <= maxNumRefrigeratedContainers
+            && totals.liquid + added.liquid <= maxNumLiquidContainers;
     }
 
-    int getID() const { return ID; }
-    int getWeight() const { return weight; }
-
-private:
     int ID;
-    int weight;
+    double fuel;
+    int currentPort;
+    Port* port; // Null until the first arrival and while at sea
+    int destinationPort; // Of the last departure
+    double legFuel;
+    const DistanceMatrix* distances;
+    int totalWeightCapacity;
+    int maxNumAllContainers;
+    int maxNumHeavyContainers;
+    int maxNumRefrigeratedContainers;
+    int maxNumLiquidContainers;
+    double fuelConsumptionPerKM;
+    ContainerSlotMap containers;
+    Load totals;
+
+    static int GenerateUniqueShipID() {
+        // Implement a method to generate unique ship IDs
+        // This is just a placeholder, actual implementation depends on your requirements
+        // Ships may be created on several threads at once
+        static std::atomic<int> nextID(0);
+        return nextID.fetch_add(1, std::memory_order_relaxed);
+    }
 };
 
-class BasicContainer : public Container {
-public:
-    BasicContainer(int id, int weight) : Container(id, weight) {}
+inline void Port::outgoingShip(Ship* s) {
+    Ship* admitted = berths.depart(s);
+    if (admitted != nullptr && listener != nullptr) {
+        listener->shipBerthed(*this, *admitted);
+    }
+    ++departures;
+    if (log != nullptr) {
+        log->append({ s->getID(), ID, s->getDestinationID(), log->getTime(), s->getLegFuel(), s->getTotalWeight() });
+    }
+}
 
-    double consumption() const override {
-        return 2.50 * getWeight();
+inline double RoutePlanner::fuelFor(const Route& route, const Ship& ship) {
+    double fuel = 0.0;
+    for (double leg : route.legs) {
+        fuel += ship.CalculateRequiredFuel(leg);
     }
-};
+    return fuel;
+}
 
-class HeavyContainer : public Container {
-public:
-    HeavyContainer(int id, int weight) : Container(id, weight) {}
+inline void Port::printPort() const {
+    std::cout << "Port ID: " << ID << " (" << latitude << ", " << longitude << ")" << std::endl;
+    // Print containers in the port
+    std::cout << "{BasicContainer, HeavyContainer, RefrigeratedContainer, LiquidContainer}: [";
+    for (const auto& cont : containers) {
+        std::cout << cont->getID() << ", ";
+    }
+    std::cout << "]" << std::endl;
 
-    double consumption() const override = 0;  // Pure virtual function
+    // Print ships in the port
+    for (const auto& ship : berths) {
+        std::cout << "Ship ID: " << ship->getID() << " FUEL_LEFT: " << std::fixed << std::setprecision(2)
+            << ship->getFuel() << std::endl;
+        ship->printContainers();
+    }
+    if (berths.getWaiting() != 0) {
+        std::cout << "Waiting for a berth: [";
+        berths.forEachWaiting([](const Ship* ship) { std::cout << ship->getID() << ", "; });
+        std::cout << "]" << std::endl;
+    }
+}
+
+struct LoadPlanOptions {
+    size_t localSearchIterations = 200000; // 0 keeps the greedy plan
+    uint64_t seed = 1;
 };
 
-class RefrigeratedContainer : public HeavyContainer {
+// Assigns a port's backlog of containers to ships about to sail legs of
+// known length. Every container costs its consumption times the length of
+// the leg it is carried on, so the planner fills the ships on the shortest
+// legs first, under each ship's count, weight and per-type limits and what
+// it already carries. The greedy pass takes the containers in order of
+// falling consumption and puts each on the first ship, by leg length, with
+// room for it; a ship is skipped for good once it has no room for a kind of
+// container. An optional local search then samples containers and moves
+// them, or swaps them with lighter ones, onto ships on shorter legs, and
+// makes room for containers the greedy pass left over by moving a container
+// from one ship to another.
+class LoadPlanner {
 public:
-    RefrigeratedContainer(int id, int weight) : HeavyContainer(id, weight) {}
+    struct Voyage {
+        Ship* ship;
+        double distance;
+    };
 
-    double consumption() const override {
-        return 5.00 * getWeight();
+    struct Plan {
+        std::vector<int> assignment; // Voyage of each backlog container, or -1
+        size_t assigned = 0;
+        double fuel = 0.0;       // Of the assigned containers over their legs
+        double greedyFuel = 0.0; // The same before the local search
+    };
+
+    static Plan plan(const std::vector<Container*>& backlog, const std::vector<Voyage>& voyages,
+        const LoadPlanOptions& options = LoadPlanOptions()) {
+        const size_t count = backlog.size();
+        std::vector<PackedContainer> packed(count);
+        std::vector<double> consumptions(count);
+        for (size_t i = 0; i < count; ++i) {
+            packed[i] = PackedContainer::of(*backlog[i]);
+            consumptions[i] = packed[i].consumption();
+        }
+
+        // Voyages by leg length; everything below works on these positions
+        std::vector<uint32_t> order(voyages.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return voyages[a].distance < voyages[b].distance;
+        });
+        std::vector<Room> rooms(order.size());
+        std::vector<double> distances(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            rooms[i] = Room::of(*voyages[order[i]].ship);
+            distances[i] = voyages[order[i]].distance;
+        }
+
+        // Greedy
+        std::vector<uint32_t> byConsumption(count);
+        for (size_t i = 0; i < count; ++i) {
+            byConsumption[i] = static_cast<uint32_t>(i);
+        }
+        std::stable_sort(byConsumption.begin(), byConsumption.end(), [&](uint32_t a, uint32_t b) {
+            return consumptions[a] > consumptions[b];
+        });
+        const int32_t Unassigned = -1;
+        std::vector<int32_t> positions(count, Unassigned);
+        size_t firstOpen[3] = { 0, 0, 0 }; // By ContainerKind
+        for (uint32_t cont : byConsumption) {
+            const PackedContainer& container = packed[cont];
+            size_t& first = firstOpen[static_cast<size_t>(container.kind)];
+            while (first < rooms.size() && !rooms[first].opensFor(container.kind)) {
+                ++first;
+            }
+            for (size_t position = first; position < rooms.size(); ++position) {
+                if (rooms[position].fits(container)) {
+                    rooms[position].take(container);
+                    positions[cont] = static_cast<int32_t>(position);
+                    break;
+                }
+            }
+        }
+
+        Plan result;
+        result.greedyFuel = fuelOf(positions, consumptions, distances);
+        if (options.localSearchIterations != 0 && count != 0 && rooms.size() > 1) {
+            improve(packed, consumptions, distances, rooms, positions, options);
+        }
+
+        result.assignment.assign(count, Unassigned);
+        for (size_t i = 0; i < count; ++i) {
+            if (positions[i] != Unassigned) {
+                result.assignment[i] = static_cast<int>(order[positions[i]]);
+                ++result.assigned;
+            }
+        }
+        result.fuel = fuelOf(positions, consumptions, distances);
+        return result;
     }
-};
 
-class LiquidContainer : public HeavyContainer {
-public:
-    LiquidContainer(int id, int weight) : HeavyContainer(id, weight) {}
+    // Loads the planned containers onto their ships; the number loaded
+    static size_t apply(const Plan& plan, const std::vector<Container*>& backlog, const std::vector<Voyage>& voyages) {
+        size_t loaded = 0;
+        for (size_t i = 0; i < backlog.size() && i < plan.assignment.size(); ++i) {
+            if (plan.assignment[i] >= 0 && voyages[plan.assignment[i]].ship->load(backlog[i])) {
+                ++loaded;
+            }
+        }
+        return loaded;
+    }
 
-    double consumption() const override {
-        return 4.00 * getWeight();
+private:
+    // What a ship can still take
+    struct Room {
+        long long weight = 0;
+        long long all = 0;
+        int heavy = 0;
+        int refrigerated = 0;
+        int liquid = 0;
+
+        static Room of(const Ship& ship) {
+            Room room;
+            room.weight = ship.getTotalWeightCapacity() - ship.getTotalWeight();
+            room.all = static_cast<long long>(ship.getMaxNumAllContainers()) - static_cast<long long>(ship.getNumAllContainers());
+            room.heavy = ship.getMaxNumHeavyContainers() - ship.getNumHeavyContainers();
+            room.refrigerated = ship.getMaxNumRefrigeratedContainers() - ship.getNumRefrigeratedContainers();
+            room.liquid = ship.getMaxNumLiquidContainers() - ship.getNumLiquidContainers();
+            return room;
+        }
+
+        // Whether any container of the kind could still fit, by count
+        bool opensFor(ContainerKind kind) const {
+            switch (kind) {
+            case ContainerKind::Refrigerated: return all > 0 && heavy > 0 && refrigerated > 0;
+            case ContainerKind::Liquid: return all > 0 && heavy > 0 && liquid > 0;
+            default: return all > 0;
+            }
+        }
+
+        bool fits(const PackedContainer& cont) const {
+            return opensFor(cont.kind) && cont.weight <= weight;
+        }
+
+        void take(const PackedContainer& cont) {
+            change(cont, -1);
+        }
+
+        void give(const PackedContainer& cont) {
+            change(cont, 1);
+        }
+
+        void change(const PackedContainer& cont, int sign) {
+            weight += sign * cont.weight;
+            all += sign;
+            if (cont.kind != ContainerKind::Basic) {
+                heavy += sign;
+                (cont.kind == ContainerKind::Refrigerated ? refrigerated : liquid) += sign;
+            }
+        }
+    };
+
+    static double fuelOf(const std::vector<int32_t>& positions, const std::vector<double>& consumptions,
+        const std::vector<double>& distances) {
+        double fuel = 0.0;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            if (positions[i] >= 0) {
+                fuel += consumptions[i] * distances[positions[i]];
+            }
+        }
+        return fuel;
+    }
+
+    // Randomized moves and swaps that each lower the fuel or carry one more
+    // container. Against the greedy plan alone no single move or swap is
+    // both possible and cheaper; they pay off once making room for left over
+    // containers has pushed others onto longer legs
+    static void improve(const std::vector<PackedContainer>& packed, const std::vector<double>& consumptions,
+        const std::vector<double>& distances, std::vector<Room>& rooms, std::vector<int32_t>& positions,
+        const LoadPlanOptions& options) {
+        // Containers on every ship, for sampling a swap partner
+        std::vector<std::vector<uint32_t>> members(rooms.size());
+        std::vector<uint32_t> slots(packed.size());
+        auto attach = [&](uint32_t cont, int32_t position) {
+            positions[cont] = position;
+            slots[cont] = static_cast<uint32_t>(members[position].size());
+            members[position].push_back(cont);
+        };
+        auto detach = [&](uint32_t cont) {
+            std::vector<uint32_t>& list = members[positions[cont]];
+            uint32_t moved = list.back();
+            list[slots[cont]] = moved;
+            slots[moved] = slots[cont];
+            list.pop_back();
+        };
+        for (size_t i = 0; i < packed.size(); ++i) {
+            if (positions[i] >= 0) {
+                int32_t position = positions[i];
+                attach(static_cast<uint32_t>(i), position);
+            }
+        }
+
+        std::mt19937_64 random(options.seed);
+        for (size_t iteration = 0; iteration < options.localSearchIterations; ++iteration) {
+            uint32_t cont = static_cast<uint32_t>(random() % packed.size());
+            const PackedContainer& container = packed[cont];
+            int32_t from = positions[cont];
+            if (from < 0) {
+                // Left over: make room on a ship by moving one of its
+                // containers to another ship
+                int32_t to = static_cast<int32_t>(random() % rooms.size());
+                if (members[to].empty()) {
+                    continue;
+                }
+                uint32_t ejected = members[to][random() % members[to].size()];
+                int32_t other = static_cast<int32_t>(random() % rooms.size());
+                Room toRoom = rooms[to];
+                toRoom.give(packed[ejected]);
+                if (other == to || !toRoom.fits(container) || !rooms[other].fits(packed[ejected])) {
+                    continue;
+                }
+                toRoom.take(container);
+                rooms[to] = toRoom;
+                rooms[other].take(packed[ejected]);
+                detach(ejected);
+                attach(ejected, other);
+                attach(cont, to);
+                continue;
+            }
+            if (from == 0) {
+                continue; // Already on the shortest leg
+            }
+            int32_t to = static_cast<int32_t>(random() % static_cast<uint64_t>(from));
+            if (distances[to] >= distances[from]) {
+                continue;
+            }
+            if (rooms[to].fits(container)) {
+                detach(cont);
+                rooms[from].give(container);
+                rooms[to].take(container);
+                attach(cont, to);
+                continue;
+            }
+            if (members[to].empty()) {
+                continue;
+            }
+            uint32_t other = members[to][random() % members[to].size()];
+            const PackedContainer& swapped = packed[other];
+            if (consumptions[other] >= consumptions[cont]) {
+                continue;
+            }
+            Room toRoom = rooms[to];
+            Room fromRoom = rooms[from];
+            toRoom.give(swapped);
+            fromRoom.give(container);
+            if (!toRoom.fits(container) || !fromRoom.fits(swapped)) {
+                continue;
+            }
+            toRoom.take(container);
+            fromRoom.take(swapped);
+            rooms[to] = toRoom;
+            rooms[from] = fromRoom;
+            detach(cont);
+            detach(other);
+            attach(cont, to);
+            attach(other, from);
+        }
     }
 };
 
-class IPort {
-public:
-    virtual void incomingShip(class Ship* s) = 0;
-    virtual void outgoingShip(class Ship* s) = 0;
+// Settings of a voyage simulation; times are in hours
+struct SimulationOptions {
+    double hours = 24.0 * 365;
+    double speed = 35.0;                 // km per hour at sea
+    double dwellHours = 12.0;            // From arrival to the start of loading
+    double loadHoursPerContainer = 0.05; // Unloading and loading
+    double refuelHours = 2.0;
+    double fuelReserve = 1.1;            // Ships take on this much of a leg's fuel
+    uint64_t seed = 1;
 };
 
-class IShip {
-public:
-    virtual bool sailTo(class Port* p) = 0;
-    virtual void reFuel(double newFuel) = 0;
-    virtual bool load(Container* cont) = 0;
-    virtual bool unLoad(Container* cont) = 0;
+struct SimulationReport {
+    uint64_t arrivals = 0;
+    uint64_t departures = 0;
+    uint64_t loads = 0;
+    uint64_t refuels = 0;
+    uint64_t containersLoaded = 0;
+    uint64_t containersUnloaded = 0;
+    uint64_t berthWaits = 0;  // Arrivals that found every berth taken
+    double berthWaitHours = 0.0;
+    double distance = 0.0;
+    double fuel = 0.0;
+    double endTime = 0.0;
+
+    uint64_t getEvents() const { return arrivals + departures + loads + refuels; }
 };
 
-class Port : public IPort {
+// Discrete-event simulation of ships sailing between ports. Every ship runs
+// the same cycle: on arrival it unloads its containers into the port, after
+// dwellHours it loads the containers waiting there that fit, then refuels
+// for a leg to a random neighbouring port and departs. The timeline is a
+// binary heap of small events ordered by time and, for equal times, by the
+// order they were scheduled, so a run is reproducible for a seed. A port
+// with limited berths keeps arriving ships waiting until a berth is free;
+// the dwell starts once the ship is berthed.
+class VoyageSimulator : private IBerthListener {
 public:
-    Port(int ID, double latitude, double longitude) : ID(ID), latitude(latitude), longitude(longitude) {}
+    explicit VoyageSimulator(const SimulationOptions& options = SimulationOptions())
+        : options(options), random(options.seed) {}
 
-    void incomingShip(Ship* s) override {
-        current.push_back(s);
-    }
+    VoyageSimulator(const VoyageSimulator&) = delete;
+    VoyageSimulator& operator=(const VoyageSimulator&) = delete;
 
-    void outgoingShip(Ship* s) override {
-        history.push_back(s);
+    // False if a port with the same ID exists or the simulation has
+    // started; the ships share a distance matrix built by the first run.
+    // berths of 0 is unlimited
+    bool addPort(int ID, double latitude, double longitude, size_t berths = 0) {
+        if (started || !portIndices.emplace(ID, ports.size()).second) {
+            return false;
+        }
+        ports.emplace_back(new Port(ID, latitude, longitude));
+        ports.back()->setBerths(berths);
+        ports.back()->useLog(log);
+        ports.back()->useListener(this);
+        routes.emplace_back();
+        distances.reset();
+        return true;
     }
 
-    double getDistance(const Port& other) const {
-        // Implement geospatial distance calculation
-        // This is just a placeholder, actual implementation depends on your requirements
-        return 0.0;
+    // Ships sail both ways along a route. Without routes a ship may sail to
+    // any other port
+    bool addRoute(int fromPortID, int toPortID) {
+        auto from = portIndices.find(fromPortID);
+        auto to = portIndices.find(toPortID);
+        if (from == portIndices.end() || to == portIndices.end() || from->second == to->second) {
+            return false;
+        }
+        routes[from->second].push_back(static_cast<uint32_t>(to->second));
+        routes[to->second].push_back(static_cast<uint32_t>(from->second));
+        return true;
     }
 
-    int getID() const { return ID; }
-    double getLatitude() const { return latitude; }
-    double getLongitude() const { return longitude; }
+    // The ship starts the simulation arriving at its port. False once the
+    // simulation has started, since the ship would never be scheduled
+    bool addShip(int portID, int totalWeightCapacity, int maxNumAllContainers, int maxNumHeavyContainers,
+        int maxNumRefrigeratedContainers, int maxNumLiquidContainers, double fuelConsumptionPerKM) {
+        if (started || portIndices.find(portID) == portIndices.end()) {
+            return false;
+        }
+        ships.emplace_back(new Ship(portID, totalWeightCapacity, maxNumAllContainers, maxNumHeavyContainers,
+            maxNumRefrigeratedContainers, maxNumLiquidContainers, fuelConsumptionPerKM));
+        shipIndices.emplace(ships.back()->getID(), static_cast<uint32_t>(ships.size() - 1));
+        destinations.push_back(0);
+        arrivalTimes.push_back(0.0);
+        return true;
+    }
 
-    void printPort() const {
-        std::cout << "Port ID: " << ID << " (" << latitude << ", " << longitude << ")" << std::endl;
-        // Print containers in the port
-        std::cout << "{BasicContainer, HeavyContainer, RefrigeratedContainer, LiquidContainer}: [";
-        for (const auto& cont : containers) {
-            std::cout << cont->getID() << ", ";
+    // A container waiting in a port
+    bool addContainer(const PackedContainer& cont, int portID) {
+        auto port = portIndices.find(portID);
+        if (port == portIndices.end()) {
+            return false;
         }
-        std::cout << "]" << std::endl;
+        std::unique_ptr<Container> container = cont.unpack();
+        if (!ports[port->second]->storeContainer(container.get())) {
+            return false;
+        }
+        containers.push_back(std::move(container));
+        return true;
+    }
 
-        // Print ships in the port
-        for (const auto& ship : current) {
-            std::cout << "Ship ID: " << ship->getID() << " FUEL_LEFT: " << std::fixed << std::setprecision(2)
-                << ship->getFuel() << std::endl;
-            ship->printContainers();
+    // Ports, Routes, Ships and Containers arrays as written by the workload
+    // generator, and an optional Simulation object overriding the options.
+    // Throws json::exception on a missing field or one of the wrong type
+    void loadScenario(const json& scenario) {
+        if (scenario.contains("Simulation")) {
+            const json& settings = scenario["Simulation"];
+            options.hours = settings.value("hours", options.hours);
+            options.speed = settings.value("speed", options.speed);
+            options.dwellHours = settings.value("dwellHours", options.dwellHours);
+            options.loadHoursPerContainer = settings.value("loadHoursPerContainer", options.loadHoursPerContainer);
+            options.refuelHours = settings.value("refuelHours", options.refuelHours);
+            options.fuelReserve = settings.value("fuelReserve", options.fuelReserve);
+            setSeed(settings.value("seed", options.seed));
+        }
+        for (const json& port : scenario.value("Ports", json::array())) {
+            addPort(port.at("ID"), port.at("lat"), port.at("lon"), port.value("berths", size_t(0)));
+        }
+        for (const json& route : scenario.value("Routes", json::array())) {
+            addRoute(route.at("from"), route.at("to"));
+        }
+        for (const json& ship : scenario.value("Ships", json::array())) {
+            addShip(ship.at("portID"), ship.at("totalWeightCapacity"), ship.at("maxNumAllContainers"),
+                ship.at("maxNumHeavyContainers"), ship.at("maxNumRefrigeratedContainers"), ship.at("maxNumLiquidContainers"),
+                ship.at("fuelConsumptionPerKM"));
+        }
+        for (const json& container : scenario.value("Containers", json::array())) {
+            const std::string type = container.value("type", "basic");
+            ContainerKind kind = type == "refrigerated" ? ContainerKind::Refrigerated
+                : type == "liquid" ? ContainerKind::Liquid : ContainerKind::Basic;
+            addContainer({ container.at("ID"), container.at("weight"), kind }, container.at("portID"));
         }
     }
 
-private:
-    int ID;
-    double latitude;
-    double longitude;
-    std::vector<Container*> containers;
-    std::vector<Ship*> history;
-    std::vector<Ship*> current;
-};
+    // Limits every port to berths ships at a time; 0 lifts the limits
+    void setBerths(size_t berths) {
+        for (const auto& port : ports) {
+            port->setBerths(berths);
+        }
+    }
 
-class Ship : public IShip {
-public:
-    Ship(int portID, int totalWeightCapacity, int maxNumAllContainers,
-        int maxNumHeavyContainers, int maxNumRefrigeratedContainers,
-        int maxNumLiquidContainers, double fuelConsumptionPerKM)
-        : ID(GenerateUniqueShipID()), fuel(0.0), totalWeightCapacity(totalWeightCapacity),
-        maxNumAllContainers(maxNumAllContainers), maxNumHeavyContainers(maxNumHeavyContainers),
-        maxNumRefrigeratedContainers(maxNumRefrigeratedContainers),
-        maxNumLiquidContainers(maxNumLiquidContainers), fuelConsumptionPerKM(fuelConsumptionPerKM) {
-        currentPort = portID;
+    // Records every departure in voyages, stamped with the simulation time
+    void useLog(VoyageLog* voyages) {
+        log = voyages;
+        for (const auto& port : ports) {
+            port->useLog(log);
+        }
     }
 
-    bool sailTo(Port* p) override {
-        double requiredFuel = CalculateRequiredFuel();
-        if (fuel >= requiredFuel) {
-            // Update ship's position and consume fuel
-            fuel -= requiredFuel;
-            currentPort->outgoingShip(this);
-            p->incomingShip(this);
-            currentPort = p;
-            return true;
+    // Runs until the timeline is empty or passes options.hours; a later call
+    // continues from there, e.g. after options.hours was raised
+    const SimulationReport& run() {
+        if (!distances) {
+            std::vector<const Port*> portPointers;
+            for (const auto& port : ports) {
+                portPointers.push_back(port.get());
+            }
+            distances.reset(new DistanceMatrix(portPointers));
         }
-        else {
-            return false;
+        if (!started && ports.size() >= 2) {
+            for (size_t i = 0; i < ships.size(); ++i) {
+                ships[i]->useDistances(distances.get());
+                schedule(0.0, Event::Arrival, i, portIndices[ships[i]->getPortID()]);
+            }
+        }
+        started = true;
+        while (!timeline.empty() && timeline.top().time <= options.hours) {
+            Event event = timeline.top();
+            timeline.pop();
+            report.endTime = event.time;
+            if (log != nullptr) {
+                log->setTime(event.time);
+            }
+            switch (event.kind) {
+            case Event::Arrival: arrive(event); break;
+            case Event::Load: load(event); break;
+            case Event::Refuel: refuel(event); break;
+            case Event::Departure: depart(event); break;
+            }
         }
+        return report;
     }
 
-    void reFuel(double newFuel) override {
-        fuel += newFuel;
+    const SimulationReport& getReport() const { return report; }
+    // Seed changes go through setSeed, which also reseeds the generator
+    SimulationOptions& getOptions() { return options; }
+
+    void setSeed(uint64_t seed) {
+        options.seed = seed;
+        random.seed(seed);
     }
+    size_t getNumPorts() const { return ports.size(); }
+    size_t getNumShips() const { return ships.size(); }
+    size_t getNumContainers() const { return containers.size(); }
 
-    bool load(Container* cont) override {
-        // Check if the ship has enough capacity
-        if (containers.size() < maxNumAllContainers) {
-            containers.push_back(cont);
-            return true;
+private:
+    struct Event {
+        enum Kind : uint8_t {
+            Arrival,
+            Load,
+            Refuel,
+            Departure
+        };
+
+        double time;
+        uint64_t sequence;
+        uint32_t ship;
+        uint32_t port;
+        Kind kind;
+    };
+
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
         }
-        else {
-            return false;
+    };
+
+    SimulationOptions options;
+    std::mt19937_64 random;
+    std::vector<std::unique_ptr<Port>> ports;
+    std::unordered_map<int, size_t> portIndices;
+    std::vector<std::vector<uint32_t>> routes;
+    std::vector<std::unique_ptr<Ship>> ships;
+    std::unordered_map<int, uint32_t> shipIndices;
+    std::vector<uint32_t> destinations; // Port index each ship sails to next
+    std::vector<double> arrivalTimes;
+    std::vector<std::unique_ptr<Container>> containers;
+    std::unique_ptr<DistanceMatrix> distances;
+    std::priority_queue<Event, std::vector<Event>, Later> timeline;
+    uint64_t sequence = 0;
+    bool started = false;
+    VoyageLog* log = nullptr;
+    std::vector<Container*> moving; // Reused between events
+    SimulationReport report;
+
+    void schedule(double time, Event::Kind kind, size_t ship, size_t port) {
+        timeline.push({ time, sequence++, static_cast<uint32_t>(ship), static_cast<uint32_t>(port), kind });
+    }
+
+    // The port calls shipBerthed now or, if the ship has to wait, when it
+    // gives the ship a berth
+    void arrive(const Event& event) {
+        Ship& ship = *ships[event.ship];
+        Port& port = *ports[event.port];
+        arrivalTimes[event.ship] = event.time;
+        ++report.arrivals;
+        ship.arrive(&port);
+        if (port.getBerths().status(&ship) == BerthRegistry::Status::Waiting) {
+            ++report.berthWaits;
         }
     }
 
-    bool unLoad(Container* cont) override {
-        // Find the container in the ship and remove it
-        auto it = std::find_if(containers.begin(), containers.end(),
-            [cont](Container* c) { return c->equals(*cont); });
+    // Unloads the ship and starts its dwell. Ports call this during arrive
+    // and depart events, so report.endTime is the current time
+    void shipBerthed(Port& port, Ship& ship) override {
+        uint32_t index = shipIndices[ship.getID()];
+        report.berthWaitHours += report.endTime - arrivalTimes[index];
+        moving.assign(ship.getContainers().begin(), ship.getContainers().end());
+        for (Container* cont : moving) {
+            ship.unLoad(cont);
+            port.storeContainer(cont);
+        }
+        report.containersUnloaded += moving.size();
+        schedule(report.endTime + options.dwellHours, Event::Load, index, portIndices[port.getID()]);
+    }
 
-        if (it != containers.end()) {
-            containers.erase(it);
-            return true;
+    // Containers that do not fit are skipped; the scan stops when the ship is
+    // full or after a few times its capacity, so a crowded port costs no more
+    // than an empty one
+    void load(const Event& event) {
+        Ship& ship = *ships[event.ship];
+        Port& port = *ports[event.port];
+        const size_t capacity = static_cast<size_t>(std::max(0, ship.getMaxNumAllContainers()));
+        size_t scanned = 0;
+        moving.clear();
+        for (auto it = port.getContainers().begin(); it != port.getContainers().end() && moving.size() < capacity
+            && scanned < 4 * capacity; ++it, ++scanned) {
+            if (ship.load(*it)) {
+                moving.push_back(*it);
+            }
         }
-        else {
-            return false;
+        for (Container* cont : moving) {
+            port.releaseContainer(cont);
         }
+        report.containersLoaded += moving.size();
+        ++report.loads;
+        schedule(event.time + options.loadHoursPerContainer * static_cast<double>(moving.size()), Event::Refuel,
+            event.ship, event.port);
     }
 
-    void printContainers() const {
-        for (const auto& cont : containers) {
-            std::cout << "  Container ID: " << cont->getID() << " Weight: " << cont->getWeight() << std::endl;
+    void refuel(const Event& event) {
+        Ship& ship = *ships[event.ship];
+        const std::vector<uint32_t>& neighbours = routes[event.port];
+        uint32_t destination;
+        if (!neighbours.empty()) {
+            destination = neighbours[random() % neighbours.size()];
+        }
+        else {
+            destination = static_cast<uint32_t>((event.port + 1 + random() % (ports.size() - 1)) % ports.size());
+        }
+        destinations[event.ship] = destination;
+        double required = ship.CalculateRequiredFuel(*ports[destination]);
+        double time = event.time;
+        if (ship.getFuel() < required) {
+            ship.reFuel(required * std::max(1.0, options.fuelReserve) - ship.getFuel());
+            time += options.refuelHours;
         }
+        ++report.refuels;
+        schedule(time, Event::Departure, event.ship, destination);
     }
 
-    int getID() const { return ID; }
-    double getFuel() const { return fuel; }
+    void depart(const Event& event) {
+        Ship& ship = *ships[event.ship];
+        Port& destination = *ports[event.port];
+        double distance = ship.distanceTo(destination);
+        double fuel = ship.getFuel();
+        if (!ship.depart(&destination)) {
+            // Only rounding can leave a refuelled ship short; top it up again
+            schedule(event.time, Event::Refuel, event.ship, portIndices[ship.getPortID()]);
+            return;
+        }
+        report.fuel += fuel - ship.getFuel();
+        report.distance += distance;
+        ++report.departures;
+        schedule(event.time + distance / options.speed, Event::Arrival, event.ship, event.port);
+    }
+};
 
-private:
-    int ID;
-    double fuel;
-    int currentPort;
+// Capacities of the lab3 ShipBuilder presets
+struct ShipPreset {
+    const char* name;
     int totalWeightCapacity;
     int maxNumAllContainers;
     int maxNumHeavyContainers;
     int maxNumRefrigeratedContainers;
     int maxNumLiquidContainers;
     double fuelConsumptionPerKM;
-    std::vector<Container*> containers;
+};
 
-    static int GenerateUniqueShipID() {
-        // Implement a method to generate unique ship IDs
-        // This is just a placeholder, actual implementation depends on your requirements
-        static int nextID = 0;
-        return nextID++;
+const ShipPreset ShipPresets[] = {
+    { "light", 500, 50, 20, 10, 5, 3.0 },
+    { "medium", 1000, 100, 40, 20, 10, 4.0 },
+    { "heavy", 1500, 150, 60, 30, 15, 5.0 }
+};
+
+// Count, mean, variance and range of a series, mergeable in any grouping
+// (Chan et al.)
+struct RunningStats {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+
+    void add(double value) {
+        RunningStats single;
+        single.count = 1;
+        single.mean = single.min = single.max = value;
+        merge(single);
     }
 
-    double CalculateRequiredFuel() const {
-        // Calculate fuel required based on ship's consumption and containers
-        double totalConsumption = fuelConsumptionPerKM;
-        for (const auto& cont : containers) {
-            totalConsumption += cont->consumption();
+    void merge(const RunningStats& other) {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        double total = static_cast<double>(count + other.count);
+        double delta = other.mean - mean;
+        mean += delta * static_cast<double>(other.count) / total;
+        m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / total;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        count += other.count;
+    }
+
+    double getStandardDeviation() const {
+        return count > 1 ? std::sqrt(m2 / static_cast<double>(count - 1)) : 0.0;
+    }
+};
+
+// What varies between the scenarios of a Monte Carlo run. Each scenario
+// draws a fuel price and a port congestion (the dwell time before loading)
+// from the ranges, and a ShipPresets entry for every ship from shipMix
+struct MonteCarloOptions {
+    size_t scenarios = 1000;
+    unsigned threads = 0; // All cores when 0
+    uint64_t seed = 1;
+    double hours = 24.0 * 90;
+    int ports = 50;
+    int ships = 20;
+    int containersPerPort = 100;
+    double minFuelPrice = 0.4;
+    double maxFuelPrice = 0.9;
+    double minDwellHours = 6.0;
+    double maxDwellHours = 72.0;
+    double shipMix[3] = { 40, 40, 20 }; // ShipPresets
+};
+
+struct MonteCarloReport {
+    RunningStats fuelCost;
+    RunningStats fuel;
+    RunningStats distance;
+    RunningStats containersLoaded;
+    RunningStats events;
+    std::vector<uint64_t> scenariosPerThread;
+};
+
+// Runs independent VoyageSimulator instances on a pool of threads. The
+// scenario indices are split into one range per thread; a thread that runs
+// out steals the upper half of the largest remaining range, so long
+// scenarios do not leave cores idle. A scenario's inputs come only from the
+// seed and its index, and every thread writes only its own scenarios'
+// result slots, so no mutable state is shared and the report is the same
+// for any number of threads. The results are merged in scenario order at
+// the end.
+class MonteCarloRunner {
+public:
+    explicit MonteCarloRunner(const MonteCarloOptions& options) : options(options) {}
+
+    MonteCarloReport run() {
+        unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, options.scenarios)));
+        std::vector<Result> results(options.scenarios);
+        std::vector<WorkRange> ranges(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            ranges[i].next = options.scenarios * i / threads;
+            ranges[i].end = options.scenarios * (i + 1) / threads;
+        }
+
+        MonteCarloReport report;
+        report.scenariosPerThread.assign(threads, 0);
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([&, i]() {
+                size_t scenario;
+                while (take(ranges, i, scenario)) {
+                    results[scenario] = runScenario(scenario);
+                    ++report.scenariosPerThread[i];
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        for (const Result& result : results) {
+            report.fuelCost.add(result.fuel * result.fuelPrice);
+            report.fuel.add(result.fuel);
+            report.distance.add(result.distance);
+            report.containersLoaded.add(static_cast<double>(result.containersLoaded));
+            report.events.add(static_cast<double>(result.events));
+        }
+        return report;
+    }
+
+    // The scenario alone, as run() would run it
+    std::unique_ptr<VoyageSimulator> buildScenario(size_t scenario, double* fuelPrice = nullptr) const {
+        std::mt19937_64 random(scenarioSeed(scenario));
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        auto between = [&](double low, double high) { return low + (high - low) * unit(random); };
+
+        SimulationOptions simulation;
+        simulation.hours = options.hours;
+        simulation.dwellHours = between(options.minDwellHours, options.maxDwellHours);
+        simulation.seed = random();
+        double price = between(options.minFuelPrice, options.maxFuelPrice);
+        if (fuelPrice != nullptr) {
+            *fuelPrice = price;
+        }
+
+        std::unique_ptr<VoyageSimulator> simulator(new VoyageSimulator(simulation));
+        for (int port = 0; port < options.ports; ++port) {
+            simulator->addPort(port, between(-60.0, 70.0), between(-180.0, 180.0));
+        }
+        std::discrete_distribution<int> presets(std::begin(options.shipMix), std::end(options.shipMix));
+        for (int ship = 0; ship < options.ships; ++ship) {
+            const ShipPreset& preset = ShipPresets[presets(random)];
+            simulator->addShip(static_cast<int>(random() % std::max(1, options.ports)), preset.totalWeightCapacity,
+                preset.maxNumAllContainers, preset.maxNumHeavyContainers, preset.maxNumRefrigeratedContainers,
+                preset.maxNumLiquidContainers, preset.fuelConsumptionPerKM);
+        }
+        // Weights around the light preset's capacity per container
+        int ID = 0;
+        for (int port = 0; port < options.ports; ++port) {
+            for (int i = 0; i < options.containersPerPort; ++i, ++ID) {
+                ContainerKind kind = static_cast<ContainerKind>(random() % 3);
+                simulator->addContainer({ ID, static_cast<int>(5 + random() % 11), kind }, port);
+            }
+        }
+        return simulator;
+    }
+
+private:
+    struct Result {
+        double fuelPrice = 0.0;
+        double fuel = 0.0;
+        double distance = 0.0;
+        uint64_t containersLoaded = 0;
+        uint64_t events = 0;
+    };
+
+    // Scenario indices [next, end) a thread has left
+    struct WorkRange {
+        std::mutex lock;
+        size_t next = 0;
+        size_t end = 0;
+    };
+
+    MonteCarloOptions options;
+
+    uint64_t scenarioSeed(size_t scenario) const {
+        // SplitMix64 of the seed and index
+        uint64_t z = options.seed + 0x9E3779B97F4A7C15ull * (scenario + 1);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    Result runScenario(size_t scenario) const {
+        Result result;
+        std::unique_ptr<VoyageSimulator> simulator = buildScenario(scenario, &result.fuelPrice);
+        const SimulationReport& report = simulator->run();
+        result.fuel = report.fuel;
+        result.distance = report.distance;
+        result.containersLoaded = report.containersLoaded;
+        result.events = report.getEvents();
+        return result;
+    }
+
+    // The next scenario from the thread's own range, or stolen from the
+    // fullest other range
+    static bool take(std::vector<WorkRange>& ranges, size_t self, size_t& scenario) {
+        {
+            std::lock_guard<std::mutex> guard(ranges[self].lock);
+            if (ranges[self].next < ranges[self].end) {
+                scenario = ranges[self].next++;
+                return true;
+            }
+        }
+        for (;;) {
+            size_t victim = self;
+            size_t most = 0;
+            for (size_t i = 0; i < ranges.size(); ++i) {
+                std::lock_guard<std::mutex> guard(ranges[i].lock);
+                if (ranges[i].end - ranges[i].next > most) {
+                    most = ranges[i].end - ranges[i].next;
+                    victim = i;
+                }
+            }
+            if (most == 0) {
+                return false;
+            }
+            size_t begin;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> guard(ranges[victim].lock);
+                size_t left = ranges[victim].end - ranges[victim].next;
+                if (left == 0) {
+                    continue; // Taken meanwhile
+                }
+                end = ranges[victim].end;
+                begin = end - (left + 1) / 2;
+                ranges[victim].end = begin;
+            }
+            std::lock_guard<std::mutex> guard(ranges[self].lock);
+            ranges[self].next = begin + 1;
+            ranges[self].end = end;
+            scenario = begin;
+            return true;
         }
-        return totalConsumption * Port(currentPort, 0, 0).getDistance(Port(0, 0, 0));
     }
 };
 
+// Runs the scenario in filename and prints a summary. With a log path the
+// departures are logged, spilling to that file beyond a few chunks. A
+// non-negative berths overrides the berths of every port
+int simulate(const std::string& filename, const SimulationOptions& options, bool hoursSet, bool seedSet,
+    const std::string& logPath, long berths) {
+    std::ifstream input(filename);
+    if (!input.is_open()) {
+        std::cerr << "Error: Unable to open scenario file." << std::endl;
+        return 1;
+    }
+    VoyageSimulator simulator(options);
+    try {
+        json scenario;
+        input >> scenario;
+        simulator.loadScenario(scenario);
+    }
+    catch (const json::exception&) {
+        std::cerr << "Error: Invalid scenario file." << std::endl;
+        return 1;
+    }
+    // The command line wins over the scenario
+    if (hoursSet) {
+        simulator.getOptions().hours = options.hours;
+    }
+    if (seedSet) {
+        simulator.setSeed(options.seed);
+    }
+    if (berths >= 0) {
+        simulator.setBerths(static_cast<size_t>(berths));
+    }
+    VoyageLog log;
+    if (!logPath.empty()) {
+        if (!log.spillTo(logPath, 16)) {
+            std::cerr << "Error: Unable to create voyage log file." << std::endl;
+            return 1;
+        }
+        simulator.useLog(&log);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const SimulationReport& report = simulator.run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Simulated " << simulator.getNumShips() << " ships, " << simulator.getNumPorts() << " ports and "
+        << simulator.getNumContainers() << " containers for " << std::fixed << std::setprecision(1) << report.endTime
+        << " hours" << std::endl;
+    std::cout << "Events: " << report.getEvents() << " (" << report.arrivals << " arrivals, " << report.loads << " loads, "
+        << report.refuels << " refuels, " << report.departures << " departures)" << std::endl;
+    std::cout << "Containers loaded: " << report.containersLoaded << " unloaded: " << report.containersUnloaded << std::endl;
+    std::cout << "Distance: " << std::setprecision(2) << report.distance << " km Fuel: " << report.fuel << std::endl;
+    if (report.berthWaits != 0) {
+        std::cout << "Waited for a berth: " << report.berthWaits << " arrivals, " << report.berthWaitHours << " hours"
+            << std::endl;
+    }
+    if (!logPath.empty()) {
+        // The last 30 days from the log
+        VoyageTotals recent = log.totals(report.endTime - 24.0 * 30, report.endTime + 1);
+        std::cout << "Voyages logged: " << log.size() << " (" << log.getChunksSpilled() << " chunks spilled, "
+            << log.getChunksInMemory() << " in memory)" << std::endl;
+        std::cout << "Last 30 days: " << recent.voyages << " voyages, fuel " << recent.fuel << ", cargo "
+            << recent.cargoWeight << std::endl;
+    }
+    std::cout << "Wall time: " << std::setprecision(3) << seconds << " s ("
+        << std::setprecision(0) << (seconds > 0 ? report.getEvents() / seconds : 0.0) << " events/s)" << std::endl;
+    return 0;
+}
+
+void printStats(const char* name, const RunningStats& stats) {
+    std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2)
+        << " mean " << stats.mean << " sd " << stats.getStandardDeviation()
+        << " min " << stats.min << " max " << stats.max << std::endl;
+}
+
+// Runs options.scenarios scenarios and prints the merged statistics
+int monteCarlo(const MonteCarloOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    MonteCarloReport report = MonteCarloRunner(options).run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Ran " << report.fuel.count << " scenarios of " << options.ships << " ships and " << options.ports
+        << " ports on " << report.scenariosPerThread.size() << " threads" << std::endl;
+    printStats("Fuel cost", report.fuelCost);
+    printStats("Fuel", report.fuel);
+    printStats("Distance (km)", report.distance);
+    printStats("Containers loaded", report.containersLoaded);
+    printStats("Events", report.events);
+    std::cout << "Wall time: " << std::setprecision(3) << seconds << " s ("
+        << std::setprecision(1) << (seconds > 0 ? report.fuel.count / seconds : 0.0) << " scenarios/s)" << std::endl;
+    return 0;
+}
+
 // Read input from JSON and print output
-int main() {
+#ifndef LAB_NO_MAIN
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "--simulate") {
+        SimulationOptions options;
+        std::string scenario = "input.json";
+        std::string logPath;
+        long berths = -1;
+        bool hoursSet = false;
+        bool seedSet = false;
+        bool validArguments = true;
+        for (int i = 2; i < argc && validArguments; ++i) {
+            const std::string argument = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (argument == "--hours" && hasValue) {
+                options.hours = std::atof(argv[++i]);
+                hoursSet = true;
+            }
+            else if (argument == "--seed" && hasValue) {
+                options.seed = std::strtoull(argv[++i], nullptr, 10);
+                seedSet = true;
+            }
+            else if (argument == "--voyage-log" && hasValue) {
+                logPath = argv[++i];
+            }
+            else if (argument == "--berths" && hasValue) {
+                berths = std::max(0L, std::atol(argv[++i]));
+            }
+            else if (i == 2 && argument.compare(0, 2, "--") != 0) {
+                scenario = argument;
+            }
+            else {
+                validArguments = false;
+            }
+        }
+        if (!validArguments) {
+            std::cerr << "Usage: " << argv[0] << " [--simulate [<scenario.json>] [--hours H] [--seed N] [--voyage-log <file>]"
+                << " [--berths B]]" << std::endl;
+            return 1;
+        }
+        return simulate(scenario, options, hoursSet, seedSet, logPath, berths);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--monte-carlo") {
+        MonteCarloOptions options;
+        options.scenarios = std::strtoull(argv[2], nullptr, 10);
+        bool validArguments = options.scenarios > 0;
+        for (int i = 3; i < argc && validArguments; ++i) {
+            const std::string argument = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (argument == "--threads" && hasValue) {
+                options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+            }
+            else if (argument == "--seed" && hasValue) {
+                options.seed = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (argument == "--hours" && hasValue) {
+                options.hours = std::atof(argv[++i]);
+            }
+            else if (argument == "--ports" && hasValue) {
+                options.ports = std::max(2, std::atoi(argv[++i]));
+            }
+            else if (argument == "--ships" && hasValue) {
+                options.ships = std::max(1, std::atoi(argv[++i]));
+            }
+            else {
+                validArguments = false;
+            }
+        }
+        if (!validArguments) {
+            std::cerr << "Usage: " << argv[0] << " --monte-carlo N [--threads T] [--seed S] [--hours H] [--ports P] [--ships S]"
+                << std::endl;
+            return 1;
+        }
+        return monteCarlo(options);
+    }
+
     // Read input from JSON file
     std::ifstream input("input.json");
     json inputData;
@@ -252,6 +2798,8 @@ int main() {
     //  Ship sails to another port
     Port destinationPort(inputData["DestinationPort"]["ID"], inputData["DestinationPort"]["lat"],
         inputData["DestinationPort"]["lon"]);
+    DistanceMatrix distances({ &port, &destinationPort });
+    ship.useDistances(&distances);
     if (ship.sailTo(&destinationPort)) {
         std::cout << "Ship sailed successfully to the destination port!" << std::endl;
     }
@@ -274,5 +2822,4 @@ int main() {
 
     return 0;
 }
-
-
+#endif
@@ -2,6 +2,7 @@
 #include <vector>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -17,7 +18,9 @@ public:
 class Item {
 public:
     Item(int containerID, double weight, int count)
-        : containerID(containerID), weight(weight), count(count), ID(IDGenerator::generateID()) {}
+        : ID(IDGenerator::generateID()), weight(weight), count(count), containerID(containerID) {}
+
+    virtual ~Item() = default;
 
     virtual double getTotalWeight() const {
         return weight * count;
@@ -88,6 +91,7 @@ private:
 
 class ItemFactory {
 public:
+    virtual ~ItemFactory() = default;
     virtual Item* createItem(int containerID, double weight, int count, bool specificAttribute) = 0;
 };
 
@@ -119,8 +123,195 @@ public:
     }
 };
 
+class IPort {
+public:
+    virtual void incomingShip(class Ship* s) = 0;
+    virtual void outgoingShip(class Ship* s) = 0;
+};
+
+class IShip {
+public:
+    virtual ~IShip() = default;
+    virtual bool sailTo(class Port* p) = 0;
+    virtual void reFuel(double newFuel) = 0;
+    virtual bool load(Item* item) = 0;
+    virtual bool unLoad(Item* item) = 0;
+    virtual void printContainers() const = 0;
+    virtual int getID() const = 0;
+    virtual double getFuel() const = 0;
+};
+
+class Port : public IPort {
+public:
+    Port(int ID, double latitude, double longitude) : ID(ID), latitude(latitude), longitude(longitude) {}
+
+    void incomingShip(Ship* s) override {
+        current.push_back(s);
+    }
+
+    void outgoingShip(Ship* s) override {
+        history.push_back(s);
+    }
+
+    double getDistance(const Port& other) const {
+       
+        return 0.0;
+    }
+
+    int getID() const { return ID; }
+    double getLatitude() const { return latitude; }
+    double getLongitude() const { return longitude; }
+
+    void printPort() const;
+
+private:
+    int ID;
+    double latitude;
+    double longitude;
+    std::vector<Item*> items;
+    std::vector<Ship*> history;
+    std::vector<Ship*> current;
+};
+
+class Ship : public IShip {
+public:
+    Ship(int portID, int totalWeightCapacity, int maxNumAllContainers,
+        int maxNumHeavyContainers, int maxNumRefrigeratedContainers,
+        int maxNumLiquidContainers, double fuelConsumptionPerKM)
+        : ID(IDGenerator::generateID()), fuel(0.0), currentPort(portID), port(nullptr),
+        totalWeightCapacity(totalWeightCapacity), maxNumAllContainers(maxNumAllContainers),
+        maxNumHeavyContainers(maxNumHeavyContainers), maxNumRefrigeratedContainers(maxNumRefrigeratedContainers),
+        maxNumLiquidContainers(maxNumLiquidContainers), fuelConsumptionPerKM(fuelConsumptionPerKM) {}
+
+    // Empty ship for a ShipBuilder to configure
+    Ship() : Ship(0, 0, 0, 0, 0, 0, 0.0) {}
+
+    bool sailTo(Port* p) override {
+        double requiredFuel = calculateRequiredFuel();
+        if (fuel >= requiredFuel) {
+            // Update ship's position and consume fuel
+            fuel -= requiredFuel;
+            if (port != nullptr) {
+                port->outgoingShip(this);
+            }
+            p->incomingShip(this);
+            port = p;
+            currentPort = p->getID();
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    void reFuel(double newFuel) override {
+        fuel += newFuel;
+    }
+
+    bool load(Item* item) override {
+        // Check if the ship has enough capacity
+        if (items.size() < static_cast<size_t>(maxNumAllContainers)) {
+            items.push_back(item);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    bool unLoad(Item* item) override {
+        // Find the item in the ship and remove it
+        auto it = std::find_if(items.begin(), items.end(),
+            [item](Item* i) { return i->getID() == item->getID(); });
+
+        if (it != items.end()) {
+            items.erase(it);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    void printContainers() const override {
+        for (const auto& item : items) {
+            std::cout << "  Item ID: " << item->getID() << " Weight: " << item->getTotalWeight() << std::endl;
+        }
+    }
+
+    int getID() const override {
+        return ID;
+    }
+
+    double getFuel() const override {
+        return fuel;
+    }
+
+    void setFuelConsumptionPerKM(double value) { fuelConsumptionPerKM = value; }
+    void setTotalWeightCapacity(int value) { totalWeightCapacity = value; }
+    void setMaxNumAllContainers(int value) { maxNumAllContainers = value; }
+    void setMaxNumHeavyContainers(int value) { maxNumHeavyContainers = value; }
+    void setMaxNumRefrigeratedContainers(int value) { maxNumRefrigeratedContainers = value; }
+    void setMaxNumLiquidContainers(int value) { maxNumLiquidContainers = value; }
+
+    int getTotalWeightCapacity() const { return totalWeightCapacity; }
+    int getMaxNumAllContainers() const { return maxNumAllContainers; }
+    int getMaxNumHeavyContainers() const { return maxNumHeavyContainers; }
+    int getMaxNumRefrigeratedContainers() const { return maxNumRefrigeratedContainers; }
+    int getMaxNumLiquidContainers() const { return maxNumLiquidContainers; }
+    double getFuelConsumptionPerKM() const { return fuelConsumptionPerKM; }
+
+    double calculateRequiredFuel() const {
+        // Calculate fuel required based on ship's consumption and items
+        double totalConsumption = fuelConsumptionPerKM;
+        for (const auto& item : items) {
+            totalConsumption += item->getTotalWeight();
+        }
+        return totalConsumption * Port(currentPort, 0, 0).getDistance(Port(0, 0, 0));
+    }
+
+private:
+    int ID;
+    double fuel;
+    int currentPort;
+    Port* port; // Null until the first sailTo
+    int totalWeightCapacity;
+    int maxNumAllContainers;
+    int maxNumHeavyContainers;
+    int maxNumRefrigeratedContainers;
+    int maxNumLiquidContainers;
+    double fuelConsumptionPerKM;
+    std::vector<Item*> items;
+};
+
+class LightWeightShip : public Ship {};
+
+class MediumShip : public Ship {};
+
+class HeavyShip : public Ship {};
+
+inline void Port::printPort() const {
+    std::cout << "Port ID: " << ID << " (" << latitude << ", " << longitude << ")" << std::endl;
+
+    // Print items in the port
+    std::cout << "{Small, Heavy, Refrigerated, Liquid}: [";
+    for (const auto& item : items) {
+        std::cout << item->getID() << ", ";
+    }
+    std::cout << "]" << std::endl;
+
+    // Print ships in the port
+    for (const auto& ship : current) {
+        std::cout << "Ship ID: " << ship->getID() << " FUEL_LEFT: " << std::fixed << std::setprecision(2)
+            << ship->getFuel() << std::endl;
+        ship->printContainers();
+    }
+}
+
+
 class ShipBuilder {
 public:
+    virtual ~ShipBuilder() = default;
     virtual void buildFuelConsumption() = 0;
     virtual void buildTotalWeightCapacity() = 0;
     virtual void buildMaxNumAllContainers() = 0;
@@ -271,168 +462,16 @@ public:
     }
 };
 
-class IPort {
-public:
-    virtual void incomingShip(class Ship* s) = 0;
-    virtual void outgoingShip(class Ship* s) = 0;
-};
-
-class IShip {
-public:
-    virtual bool sailTo(class Port* p) = 0;
-    virtual void reFuel(double newFuel) = 0;
-    virtual bool load(Item* item) = 0;
-    virtual bool unLoad(Item* item) = 0;
-    virtual void printContainers() const = 0;
-    virtual int getID() const = 0;
-    virtual double getFuel() const = 0;
-};
-
-class Port : public IPort {
-public:
-    Port(int ID, double latitude, double longitude) : ID(ID), latitude(latitude), longitude(longitude) {}
-
-    void incomingShip(Ship* s) override {
-        current.push_back(s);
-    }
-
-    void outgoingShip(Ship* s) override {
-        history.push_back(s);
-    }
-
-    double getDistance(const Port& other) const {
-       
-        return 0.0;
-    }
-
-    int getID() const { return ID; }
-    double getLatitude() const { return latitude; }
-    double getLongitude() const { return longitude; }
-
-    void printPort() const {
-        std::cout << "Port ID: " << ID << " (" << latitude << ", " << longitude << ")" << std::endl;
-
-        // Print items in the port
-        std::cout << "{Small, Heavy, Refrigerated, Liquid}: [";
-        for (const auto& item : items) {
-            std::cout << item->getID() << ", ";
-        }
-        std::cout << "]" << std::endl;
-
-        // Print ships in the port
-        for (const auto& ship : current) {
-            std::cout << "Ship ID: " << ship->getID() << " FUEL_LEFT: " << std::fixed << std::setprecision(2)
-                << ship->getFuel() << std::endl;
-            ship->printContainers();
-        }
-    }
-
-private:
-    int ID;
-    double latitude;
-    double longitude;
-    std::vector<Item*> items;
-    std::vector<Ship*> history;
-    std::vector<Ship*> current;
-};
-
-class Ship : public IShip {
-public:
-    Ship(int portID, int totalWeightCapacity, int maxNumAllContainers,
-        int maxNumHeavyContainers, int maxNumRefrigeratedContainers,
-        int maxNumLiquidContainers, double fuelConsumptionPerKM)
-        : ID(IDGenerator::generateID()), fuel(0.0), currentPort(portID),
-        totalWeightCapacity(totalWeightCapacity), maxNumAllContainers(maxNumAllContainers),
-        maxNumHeavyContainers(maxNumHeavyContainers), maxNumRefrigeratedContainers(maxNumRefrigeratedContainers),
-        maxNumLiquidContainers(maxNumLiquidContainers), fuelConsumptionPerKM(fuelConsumptionPerKM) {}
-
-    bool sailTo(Port* p) override {
-        double requiredFuel = calculateRequiredFuel();
-        if (fuel >= requiredFuel) {
-            // Update ship's position and consume fuel
-            fuel -= requiredFuel;
-            currentPort->outgoingShip(this);
-            p->incomingShip(this);
-            currentPort = p;
-            return true;
-        }
-        else {
-            return false;
-        }
-    }
-
-    void reFuel(double newFuel) override {
-        fuel += newFuel;
-    }
-
-    bool load(Item* item) override {
-        // Check if the ship has enough capacity
-        if (items.size() < maxNumAllContainers) {
-            items.push_back(item);
-            return true;
-        }
-        else {
-            return false;
-        }
-    }
-
-    bool unLoad(Item* item) override {
-        // Find the item in the ship and remove it
-        auto it = std::find_if(items.begin(), items.end(),
-            [item](Item* i) { return i->getID() == item->getID(); });
-
-        if (it != items.end()) {
-            items.erase(it);
-            return true;
-        }
-        else {
-            return false;
-        }
-    }
-
-    void printContainers() const override {
-        for (const auto& item : items) {
-            std::cout << "  Item ID: " << item->getID() << " Weight: " << item->getTotalWeight() << std::endl;
-        }
-    }
-
-    int getID() const override {
-        return ID;
-    }
-
-    double getFuel() const override {
-        return fuel;
-    }
-
-private:
-    int ID;
-    double fuel;
-    int currentPort;
-    int totalWeightCapacity;
-    int maxNumAllContainers;
-    int maxNumHeavyContainers;
-    int maxNumRefrigeratedContainers;
-    int maxNumLiquidContainers;
-    double fuelConsumptionPerKM;
-    std::vector<Item*> items;
-
-    double calculateRequiredFuel() const {
-        // Calculate fuel required based on ship's consumption and items
-        double totalConsumption = fuelConsumptionPerKM;
-        for (const auto& item : items) {
-            totalConsumption += item->getTotalWeight();
-        }
-        return totalConsumption * Port(currentPort, 0, 0).getDistance(Port(0, 0, 0));
-    }
-};
-
 // Main function
+#ifndef LAB_NO_MAIN
 int main() {
     // Read input from JSON file
     std::ifstream input("input.json");
     json inputData;
     input >> inputData;
 
+    Port port(inputData["Port"]["ID"], inputData["Port"]["lat"], inputData["Port"]["lon"]);
+
     // Creating items using the factory pattern
     ItemFactory* smallFactory = new SmallFactory();
     Item* smallItem = smallFactory->createItem(1, 10.0, 5, true);
@@ -463,3 +502,4 @@ int main() {
 
     return 0;
 }
+#endif
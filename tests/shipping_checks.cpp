@@ -0,0 +1,279 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <queue>
+#include <random>
+
+#include "../lab2arch/lab2arch/lab1arch.cpp"
+
+namespace {
+
+// count ports spread uniformly over the globe
+std::vector<Port> makePorts(size_t count, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> latitudeDistribution(-80.0, 80.0);
+    std::uniform_real_distribution<double> longitudeDistribution(-180.0, 180.0);
+    std::vector<Port> ports;
+    ports.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        ports.emplace_back(static_cast<int>(i), latitudeDistribution(random), longitudeDistribution(random));
+    }
+    return ports;
+}
+
+bool fail(const std::string& check, const std::string& message) {
+    std::cerr << check << ": " << message << std::endl;
+    return false;
+}
+
+bool close(double actual, double expected) {
+    return actual == expected || std::abs(actual - expected) <= 1e-9 * std::abs(expected);
+}
+
+using RouteGraph = std::vector<std::vector<std::pair<int, double>>>;
+
+// Length of the shortest route by plain Dijkstra; infinite if there is none
+double shortestRoute(const RouteGraph& graph, int from, int to) {
+    std::vector<double> lengths(graph.size(), std::numeric_limits<double>::infinity());
+    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<>> queue;
+    lengths[from] = 0.0;
+    queue.push({ 0.0, from });
+    while (!queue.empty()) {
+        auto [length, port] = queue.top();
+        queue.pop();
+        if (port == to) {
+            return length;
+        }
+        if (length > lengths[port]) {
+            continue;
+        }
+        for (const auto& edge : graph[port]) {
+            if (length + edge.second < lengths[edge.first]) {
+                lengths[edge.first] = length + edge.second;
+                queue.push({ lengths[edge.first], edge.first });
+            }
+        }
+    }
+    return lengths[to];
+}
+
+// RoutePlanner against Dijkstra on a ring with random chords, and on a
+// sparse random graph where some ports cannot be reached. Every route found
+// must follow existing routes, and its legs must add up to its length.
+bool checkRoutePlanner() {
+    for (bool ring : { true, false }) {
+        std::vector<Port> ports = makePorts(2000, ring ? 42 : 43);
+        RoutePlanner planner(ring ? 0 : 256);
+        for (Port& port : ports) {
+            planner.addPort(&port);
+        }
+        std::mt19937_64 random(7);
+        const int count = static_cast<int>(ports.size());
+        RouteGraph graph(ports.size());
+        for (int port = 0; port < count; ++port) {
+            for (int to : { ring ? (port + 1) % count : static_cast<int>(random() % count), static_cast<int>(random() % count) }) {
+                if (ring || port % 2 == 0) {
+                    if (planner.addRoute(port, to)) {
+                        double length = ports[port].getDistance(ports[to]);
+                        graph[port].push_back({ to, length });
+                        graph[to].push_back({ port, length });
+                    }
+                }
+            }
+        }
+        for (int query = 0; query < 200; ++query) {
+            int from = static_cast<int>(random() % count);
+            int to = static_cast<int>(random() % count);
+            double expected = shortestRoute(graph, from, to);
+            RoutePlanner::Route route = planner.find(from, to);
+            if (route.found() != !std::isinf(expected)) {
+                return fail("RoutePlanner", "route " + std::to_string(from) + " -> " + std::to_string(to) + " found by only one search");
+            }
+            if (!route.found()) {
+                continue;
+            }
+            if (!close(route.distance, expected)) {
+                return fail("RoutePlanner", "route " + std::to_string(from) + " -> " + std::to_string(to) + " is "
+                    + std::to_string(route.distance) + " km, Dijkstra finds " + std::to_string(expected) + " km");
+            }
+            if (route.stops.front()->getID() != from || route.stops.back()->getID() != to || route.legs.size() + 1 != route.stops.size()) {
+                return fail("RoutePlanner", "route " + std::to_string(from) + " -> " + std::to_string(to) + " has the wrong ends");
+            }
+            double total = 0.0;
+            for (size_t i = 0; i < route.legs.size(); ++i) {
+                const auto& edges = graph[route.stops[i]->getID()];
+                int next = route.stops[i + 1]->getID();
+                bool exists = std::any_of(edges.begin(), edges.end(), [&](const std::pair<int, double>& edge) {
+                    return edge.first == next && edge.second == route.legs[i];
+                });
+                if (!exists) {
+                    return fail("RoutePlanner", "route " + std::to_string(from) + " -> " + std::to_string(to) + " uses a leg that is not a route");
+                }
+                total += route.legs[i];
+            }
+            if (!close(total, route.distance)) {
+                return fail("RoutePlanner", "legs of " + std::to_string(from) + " -> " + std::to_string(to) + " do not add up to its length");
+            }
+        }
+    }
+    return true;
+}
+
+// Whether the index answers point as a scan over every port does. Ports
+// within 1e-6 km of the radius may fall either way.
+bool matchesBruteForce(const PortIndex& index, const std::vector<Port>& ports, const Port& point, size_t k, double radius) {
+    std::vector<double> distances;
+    distances.reserve(ports.size());
+    for (const Port& port : ports) {
+        distances.push_back(point.getDistance(port));
+    }
+    std::sort(distances.begin(), distances.end());
+    for (const auto& found : { index.nearest(point.getLatitude(), point.getLongitude(), k),
+                               index.within(point.getLatitude(), point.getLongitude(), radius) }) {
+        for (size_t i = 0; i < found.size(); ++i) {
+            if (i >= distances.size() || std::abs(found[i].distance - distances[i]) > 1e-6
+                || std::abs(found[i].distance - point.getDistance(*found[i].port)) > 1e-6) {
+                return false;
+            }
+        }
+    }
+    if (index.nearest(point.getLatitude(), point.getLongitude(), k).size() != std::min(k, ports.size())) {
+        return false;
+    }
+    size_t within = index.within(point.getLatitude(), point.getLongitude(), radius).size();
+    return within >= static_cast<size_t>(std::upper_bound(distances.begin(), distances.end(), radius - 1e-6) - distances.begin())
+        && within <= static_cast<size_t>(std::upper_bound(distances.begin(), distances.end(), radius + 1e-6) - distances.begin());
+}
+
+// PortIndex against a brute-force scan for every k and radius from none
+// to more than half the circumference, and batched queries against
+// single ones
+bool checkPortIndex() {
+    for (size_t count : { 1, 7, 1000, 20000 }) {
+        std::vector<Port> ports = makePorts(count, count);
+        std::vector<Port*> pointers;
+        for (Port& port : ports) {
+            pointers.push_back(&port);
+        }
+        PortIndex index(pointers);
+        std::vector<Port> points = makePorts(64, count + 1);
+        points.push_back(ports.front()); // A query on a port itself
+        for (const Port& point : points) {
+            for (size_t k : { 0, 1, 8, 50 }) {
+                for (double radius : { 0.0, 500.0, 5000.0, 25000.0 }) {
+                    if (!matchesBruteForce(index, ports, point, k, radius)) {
+                        return fail("PortIndex", std::to_string(count) + " ports disagree with a brute-force scan for k = "
+                            + std::to_string(k) + ", radius " + std::to_string(radius) + " km");
+                    }
+                }
+            }
+        }
+        std::vector<PortIndex::Point> batch;
+        for (const Port& point : points) {
+            batch.push_back({ point.getLatitude(), point.getLongitude() });
+        }
+        auto nearest = index.nearest(batch, 8, 4);
+        auto within = index.within(batch, 500.0, 4);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto single = index.nearest(batch[i].latitude, batch[i].longitude, 8);
+            auto around = index.within(batch[i].latitude, batch[i].longitude, 500.0);
+            auto same = [](const std::vector<PortIndex::Neighbour>& a, const std::vector<PortIndex::Neighbour>& b) {
+                return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const PortIndex::Neighbour& x, const PortIndex::Neighbour& y) {
+                    return x.port == y.port && x.distance == y.distance;
+                });
+            };
+            if (!same(nearest[i], single) || !same(within[i], around)) {
+                return fail("PortIndex", "batched queries over " + std::to_string(count) + " ports differ from single ones");
+            }
+        }
+    }
+    return true;
+}
+
+bool sameRecord(const VoyageRecord& a, const VoyageRecord& b) {
+    return a.shipID == b.shipID && a.fromPortID == b.fromPortID && a.toPortID == b.toPortID
+        && a.time == b.time && a.fuel == b.fuel && a.cargoWeight == b.cargoWeight;
+}
+
+// Whether scans and totals of log agree with the records appended to it
+bool matchesRecords(const VoyageLog& log, const std::vector<VoyageRecord>& records) {
+    if (log.size() != records.size()) {
+        return false;
+    }
+    size_t next = 0;
+    bool same = true;
+    log.scan(-1.0, HUGE_VAL, [&](const VoyageRecord& record) {
+        same = same && next < records.size() && sameRecord(record, records[next]);
+        ++next;
+    });
+    if (!same || next != records.size()) {
+        return false;
+    }
+    const double end = records.size() * 0.25;
+    for (double from : { 0.0, end * 0.1, end * 0.45, end * 0.9 }) {
+        for (int portID : { -1, 0, 13 }) {
+            VoyageTotals expected;
+            for (const VoyageRecord& record : records) {
+                if (record.time >= from && record.time < from + end * 0.2 && (portID < 0 || record.fromPortID == portID)) {
+                    ++expected.voyages;
+                    expected.fuel += record.fuel;
+                    expected.cargoWeight += record.cargoWeight;
+                }
+            }
+            VoyageTotals actual = log.totals(from, from + end * 0.2, portID);
+            if (actual.voyages != expected.voyages || !close(actual.fuel, expected.fuel) || actual.cargoWeight != expected.cargoWeight) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// VoyageLog read back from its spill file: records appended before and
+// after spilling starts, times slightly out of order so chunks overlap,
+// and scans between appends so the file is mapped again as it grows. The
+// same records kept in memory must give the same answers.
+bool checkVoyageLog() {
+    const std::string spillPath = (std::filesystem::temp_directory_path()
+        / ("voyage_log_check_" + std::to_string(std::random_device()()) + ".bin")).string();
+    bool passed = true;
+    {
+        VoyageLog spilling;
+        VoyageLog inMemory;
+        std::vector<VoyageRecord> records;
+        for (int i = 0; i < 100000 && passed; ++i) {
+            VoyageRecord record = { i % 1000, i % 97, (i + 1) % 97, i * 0.25 + (i * 7919 % 64) * 0.5, 10.0 + i % 13, i % 5000 };
+            if (i == 20000 && !spilling.spillTo(spillPath, 3)) {
+                return fail("VoyageLog", "unable to create " + spillPath);
+            }
+            spilling.append(record);
+            inMemory.append(record);
+            records.push_back(record);
+            if (i % 30000 == 29999) {
+                passed = matchesRecords(spilling, records) && matchesRecords(inMemory, records);
+            }
+        }
+        passed = passed && matchesRecords(spilling, records) && matchesRecords(inMemory, records);
+        if (!passed) {
+            fail("VoyageLog", "a log disagrees with the records appended to it");
+        } else if (spilling.getChunksSpilled() == 0 || spilling.getChunksInMemory() > 4) {
+            passed = fail("VoyageLog", "the log kept " + std::to_string(spilling.getChunksInMemory()) + " chunks in memory");
+        } else if (spilling.spillTo(spillPath, 3)) {
+            passed = fail("VoyageLog", "a log spilled to a second file");
+        }
+    }
+    // The log has closed the file
+    std::remove(spillPath.c_str());
+    return passed;
+}
+
+}
+
+int main() {
+    bool passed = checkRoutePlanner();
+    passed = checkPortIndex() && passed;
+    passed = checkVoyageLog() && passed;
+    std::cout << (passed ? "All shipping checks passed." : "Shipping checks failed.") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,960 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+// Generates seeded, production-shaped inputs for the three labs: input.json
+// compatible with each lab plus the same data in a compact binary form.
+//
+//   workload_generator --lab 1 --customers 1000000 --actions 100000000 --zipf 1.1 --out big
+//
+// writes big.json and big.bin. All random numbers come from one
+// SplitMix64 stream and the distributions below, so the raw stream of a seed
+// is the same everywhere. The Zipf and continuous distributions go through
+// libm (log, exp, sin, ...) and decimals are formatted with snprintf, both of
+// which may round differently between C libraries, so a seed reproduces the
+// same files with the same toolchain and C library, not across them.
+//
+// Binary form: the magic "ARCHGEN1", uint32 version, uint32 lab, uint64
+// seed, then sections of { uint32 kind, uint32 recordSize, uint64 count }
+// followed by count fixed-size records (the fields of the *Record structs
+// below, in order). Every integer is written little endian and every double
+// as the little-endian bytes of its IEEE 754 bits, whatever the host.
+// Customer names live in the NamePool section.
+
+const double Pi = 3.14159265358979323846;
+
+class Random {
+private:
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1)
+    double uniform() {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double uniform(double low, double high) {
+        return low + (high - low) * uniform();
+    }
+
+    // Uniform in [low, high]
+    int64_t integer(int64_t low, int64_t high) {
+        uint64_t range = static_cast<uint64_t>(high - low) + 1;
+        return low + static_cast<int64_t>(next() % range);
+    }
+
+    double exponential(double mean) {
+        return -mean * std::log1p(-uniform());
+    }
+
+    bool chance(double probability) {
+        return uniform() < probability;
+    }
+};
+
+// Picks an index with probability proportional to its weight
+class WeightedChoice {
+private:
+    std::vector<double> cumulative;
+
+public:
+    explicit WeightedChoice(const std::vector<double>& weights) {
+        double total = 0.0;
+        for (double weight : weights) {
+            total += std::max(0.0, weight);
+            cumulative.push_back(total);
+        }
+        if (total <= 0.0) {
+            std::iota(cumulative.begin(), cumulative.end(), 1.0);
+        }
+    }
+
+    size_t operator()(Random& random) const {
+        double target = random.uniform() * cumulative.back();
+        size_t index = std::upper_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin();
+        return std::min(index, cumulative.size() - 1);
+    }
+};
+
+// Zipf-distributed ranks 1..count by rejection-inversion (Hormann and
+// Derflinger), constant memory for any count. An exponent of zero is
+// uniform. Ranks are spread over the indices by a fixed permutation, so the
+// most popular customers are not simply the first ones.
+class ZipfDistribution {
+private:
+    uint64_t count;
+    double exponent;
+    double hIntegralX1;
+    double hIntegralCount;
+    double s;
+    uint64_t multiplier;
+
+    static double helper1(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    static double helper2(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+    }
+
+    double h(double x) const {
+        return std::exp(-exponent * std::log(x));
+    }
+
+    double hIntegral(double x) const {
+        double logX = std::log(x);
+        return helper2((1.0 - exponent) * logX) * logX;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = std::max(-1.0, x * (1.0 - exponent));
+        return std::exp(helper1(t) * x);
+    }
+
+public:
+    ZipfDistribution(uint64_t count, double exponent) : count(std::max<uint64_t>(1, count)), exponent(exponent) {
+        hIntegralX1 = hIntegral(1.5) - 1.0;
+        hIntegralCount = hIntegral(static_cast<double>(this->count) + 0.5);
+        s = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+        multiplier = 2654435761ull % this->count;
+        while (multiplier == 0 || std::gcd(multiplier, this->count) != 1) {
+            multiplier = (multiplier + 1) % this->count;
+            if (this->count == 1) {
+                break;
+            }
+        }
+    }
+
+    // 1 is the most popular rank
+    uint64_t rank(Random& random) const {
+        if (exponent <= 0.0) {
+            return 1 + random.next() % count;
+        }
+        for (;;) {
+            double u = hIntegralCount + random.uniform() * (hIntegralX1 - hIntegralCount);
+            double x = hIntegralInverse(u);
+            double k = std::min(static_cast<double>(count), std::max(1.0, std::floor(x + 0.5)));
+            if (k - x <= s || u >= hIntegral(k + 0.5) - h(k)) {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+
+    uint64_t operator()(Random& random) const {
+        return count == 1 ? 0 : (rank(random) - 1) * multiplier % count;
+    }
+};
+
+// Buffered text output with the bits of JSON the generator needs
+class JsonStream {
+private:
+    FILE* file;
+    std::string buffer;
+    bool ok;
+    bool first;
+    bool firstElement;
+
+    // Once a write has failed nothing more is written
+    void drain() {
+        if (file != nullptr && ok && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            ok = false;
+        }
+        buffer.clear();
+    }
+
+public:
+    JsonStream() : file(nullptr), ok(true), first(true), firstElement(true) {}
+
+    ~JsonStream() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        file = std::fopen(path.c_str(), "wb");
+        buffer.reserve(1 << 20);
+        return file != nullptr;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // False if anything written since open did not reach the file
+    bool close() {
+        if (file != nullptr) {
+            drain();
+            ok = std::fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+        return ok;
+    }
+
+    JsonStream& raw(const char* text) {
+        if (file != nullptr) {
+            buffer += text;
+            if (buffer.size() >= (1 << 20)) {
+                drain();
+            }
+        }
+        return *this;
+    }
+
+    JsonStream& integer(int64_t value) {
+        if (file != nullptr) {
+            char digits[24];
+            buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        }
+        return *this;
+    }
+
+    // Fixed-point with the given number of decimals
+    JsonStream& number(double value, int decimals) {
+        if (file != nullptr) {
+            char digits[48];
+            int length = std::snprintf(digits, sizeof(digits), "%.*f", decimals, value);
+            buffer.append(digits, static_cast<size_t>(length));
+        }
+        return *this;
+    }
+
+    JsonStream& string(const std::string& value) {
+        return raw("\"").raw(value.c_str()).raw("\"");
+    }
+
+    JsonStream& boolean(bool value) {
+        return raw(value ? "true" : "false");
+    }
+
+    // Starts "name": [ ... ]
+    void beginArray(const char* name) {
+        raw(first ? "{\n  \"" : ",\n  \"").raw(name).raw("\": [");
+        first = false;
+        firstElement = true;
+    }
+
+    // Separator before the next element of the current array
+    JsonStream& element() {
+        raw(firstElement ? "\n    " : ",\n    ");
+        firstElement = false;
+        return *this;
+    }
+
+    void endArray() {
+        raw(firstElement ? "]" : "\n  ]");
+    }
+
+    // Starts "name": followed by a value written by the caller
+    JsonStream& member(const char* name) {
+        raw(first ? "{\n  \"" : ",\n  \"").raw(name).raw("\": ");
+        first = false;
+        return *this;
+    }
+
+    void end() {
+        raw(first ? "{}\n" : "\n}\n");
+    }
+};
+
+enum class SectionKind : uint32_t {
+    Operators = 1,
+    Customers = 2,
+    NamePool = 3,
+    Actions = 4,
+    Ports = 5,
+    Routes = 6,
+    Ships = 7,
+    Containers = 8,
+    Items = 9
+};
+
+// Fixed-size records of the binary form
+struct OperatorRecord {
+    int32_t ID;
+    int32_t discountRate;
+    int64_t talkingCharge; // Money micros
+    int64_t messageCost;
+    int64_t networkCharge;
+    int32_t plan;          // Index into PlanNames
+    int32_t reserved;
+};
+
+struct CustomerRecord {
+    int32_t ID;
+    int32_t age;
+    int32_t operatorID;
+    uint32_t nameLength;
+    uint64_t nameOffset;
+    int64_t billLimit;     // Money micros
+};
+
+struct ActionRecord {
+    int64_t time;
+    double amount;         // Data amount, payment or new limit
+    int32_t customerID;
+    int32_t other;         // Other customer, or the new operator
+    int32_t count;         // Minutes or messages
+    uint8_t type;          // Index into ActionNames
+    uint8_t reserved[3];
+};
+
+struct PortRecord {
+    int32_t ID;
+    int32_t reserved;
+    double latitude;
+    double longitude;
+};
+
+struct RouteRecord {
+    int32_t from;
+    int32_t to;
+    double distance;       // km
+};
+
+struct ShipRecord {
+    int32_t ID;
+    int32_t portID;
+    int32_t type;          // Index into ShipTypes
+    int32_t totalWeightCapacity;
+    int32_t maxNumAllContainers;
+    int32_t maxNumHeavyContainers;
+    int32_t maxNumRefrigeratedContainers;
+    int32_t maxNumLiquidContainers;
+    double fuelConsumptionPerKM;
+};
+
+struct ContainerRecord {
+    int32_t ID;
+    int32_t weight;
+    int32_t portID;
+    int32_t type;          // Index into ContainerTypes
+};
+
+struct ItemRecord {
+    int32_t ID;
+    int32_t containerID;
+    double weight;
+    int32_t count;
+    uint8_t type;          // Index into ItemTypes
+    uint8_t specificAttribute;
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(OperatorRecord) == 40 && sizeof(CustomerRecord) == 32 && sizeof(ActionRecord) == 32
+    && sizeof(PortRecord) == 24 && sizeof(RouteRecord) == 16 && sizeof(ShipRecord) == 40
+    && sizeof(ContainerRecord) == 16 && sizeof(ItemRecord) == 24, "records have no padding, so recordSize is their written size");
+
+// Writes the binary form field by field, so its byte order and layout do
+// not depend on the host
+class BinaryStream {
+private:
+    FILE* file;
+    std::string buffer;
+    bool ok;
+
+    // Once a write has failed nothing more is written
+    void drain() {
+        if (file != nullptr && ok && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            ok = false;
+        }
+        buffer.clear();
+    }
+
+    void put(uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) {
+            buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+        if (buffer.size() >= (1 << 20)) {
+            drain();
+        }
+    }
+
+    void put(uint8_t value) { put(value, 1); }
+    void put(int32_t value) { put(static_cast<uint32_t>(value), 4); }
+    void put(uint32_t value) { put(value, 4); }
+    void put(int64_t value) { put(static_cast<uint64_t>(value), 8); }
+    void put(uint64_t value) { put(value, 8); }
+
+    void put(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put(bits, 8);
+    }
+
+    template <size_t Count>
+    void put(const uint8_t (&bytes)[Count]) {
+        for (uint8_t byte : bytes) {
+            put(byte);
+        }
+    }
+
+public:
+    static constexpr char Magic[8] = { 'A', 'R', 'C', 'H', 'G', 'E', 'N', '1' };
+    static constexpr uint32_t Version = 1;
+
+    BinaryStream() : file(nullptr), ok(true) {}
+
+    ~BinaryStream() {
+        close();
+    }
+
+    bool open(const std::string& path, uint32_t lab, uint64_t seed) {
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        buffer.reserve(1 << 20);
+        write(Magic, sizeof(Magic));
+        put(Version);
+        put(lab);
+        put(seed);
+        return true;
+    }
+
+    // False if anything written since open did not reach the file
+    bool close() {
+        if (file != nullptr) {
+            drain();
+            ok = std::fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+        return ok;
+    }
+
+    template <typename Record>
+    void beginSection(SectionKind kind, uint64_t count) {
+        beginSection(kind, sizeof(Record), count);
+    }
+
+    void beginSection(SectionKind kind, uint32_t recordSize, uint64_t count) {
+        if (file != nullptr) {
+            put(static_cast<uint32_t>(kind));
+            put(recordSize);
+            put(count);
+        }
+    }
+
+    void write(const void* data, size_t size) {
+        if (file != nullptr) {
+            buffer.append(static_cast<const char*>(data), size);
+            if (buffer.size() >= (1 << 20)) {
+                drain();
+            }
+        }
+    }
+
+    void record(const OperatorRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.discountRate);
+            put(value.talkingCharge);
+            put(value.messageCost);
+            put(value.networkCharge);
+            put(value.plan);
+            put(value.reserved);
+        }
+    }
+
+    void record(const CustomerRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.age);
+            put(value.operatorID);
+            put(value.nameLength);
+            put(value.nameOffset);
+            put(value.billLimit);
+        }
+    }
+
+    void record(const ActionRecord& value) {
+        if (file != nullptr) {
+            put(value.time);
+            put(value.amount);
+            put(value.customerID);
+            put(value.other);
+            put(value.count);
+            put(value.type);
+            put(value.reserved);
+        }
+    }
+
+    void record(const PortRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.reserved);
+            put(value.latitude);
+            put(value.longitude);
+        }
+    }
+
+    void record(const RouteRecord& value) {
+        if (file != nullptr) {
+            put(value.from);
+            put(value.to);
+            put(value.distance);
+        }
+    }
+
+    void record(const ShipRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.portID);
+            put(value.type);
+            put(value.totalWeightCapacity);
+            put(value.maxNumAllContainers);
+            put(value.maxNumHeavyContainers);
+            put(value.maxNumRefrigeratedContainers);
+            put(value.maxNumLiquidContainers);
+            put(value.fuelConsumptionPerKM);
+        }
+    }
+
+    void record(const ContainerRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.weight);
+            put(value.portID);
+            put(value.type);
+        }
+    }
+
+    void record(const ItemRecord& value) {
+        if (file != nullptr) {
+            put(value.ID);
+            put(value.containerID);
+            put(value.weight);
+            put(value.count);
+            put(value.type);
+            put(value.specificAttribute);
+            put(value.reserved);
+        }
+    }
+};
+
+const char* const PlanNames[] = { "standard", "offpeak", "volume", "flat" };
+const char* const ActionNames[] = { "talk", "message", "connect", "pay", "changeOperator", "changeBillLimit" };
+const char* const ShipTypes[] = { "light", "medium", "heavy" };
+const char* const ContainerTypes[] = { "basic", "refrigerated", "liquid" };
+const char* const ItemTypes[] = { "small", "heavy", "refrigerated", "liquid" };
+
+// Capacities of the lab3 ShipBuilder presets; the weight capacity is sized
+// for containers of the generated weights
+struct ShipPreset {
+    int maxNumAllContainers;
+    int maxNumHeavyContainers;
+    int maxNumRefrigeratedContainers;
+    int maxNumLiquidContainers;
+    double fuelConsumptionPerKM;
+};
+
+const ShipPreset ShipPresets[] = {
+    { 50, 20, 10, 5, 3.0 },
+    { 100, 40, 20, 10, 4.0 },
+    { 150, 60, 30, 15, 5.0 }
+};
+
+struct GeneratorOptions {
+    int lab = 1;
+    uint64_t seed = 1;
+    std::string out = "workload";
+    bool json = true;
+    bool binary = true;
+    double zipf = 1.0;
+
+    // Lab 1
+    uint64_t customers = 1000;
+    uint64_t operators = 5;
+    uint64_t actions = 100000;
+    uint64_t days = 30;
+    std::vector<double> operatorMix;                        // Uniform when empty
+    std::vector<double> planMix = { 70, 10, 10, 10 };        // PlanNames
+    std::vector<double> ageMix = { 15, 65, 20 };             // Under 18, 18-65, over 65
+    std::vector<double> actionMix = { 35, 25, 15, 15, 5, 5 }; // ActionNames
+
+    // Labs 2 and 3
+    uint64_t ports = 100;
+    uint64_t routesPerPort = 3;
+    uint64_t ships = 50;
+    uint64_t containers = 10000;
+    uint64_t items = 100000;
+    std::vector<double> shipMix = { 40, 40, 20 };            // ShipTypes
+    std::vector<double> containerMix = { 60, 25, 15 };       // ContainerTypes
+    std::vector<double> itemMix = { 40, 30, 20, 10 };        // ItemTypes
+};
+
+int64_t toMicros(double amount) {
+    return static_cast<int64_t>(std::llround(amount * 1000000.0));
+}
+
+double roundTo(double value, double step) {
+    return std::round(value / step) * step;
+}
+
+void generateBilling(const GeneratorOptions& options, Random& random, JsonStream& json, BinaryStream& binary) {
+    const uint64_t operatorCount = std::max<uint64_t>(1, options.operators);
+    const uint64_t customerCount = std::max<uint64_t>(1, options.customers);
+
+    json.beginArray("operators");
+    binary.beginSection<OperatorRecord>(SectionKind::Operators, operatorCount);
+    WeightedChoice plans(options.planMix);
+    for (uint64_t i = 0; i < operatorCount; ++i) {
+        OperatorRecord record = {};
+        record.ID = static_cast<int32_t>(i);
+        double talkingCharge = roundTo(random.uniform(0.05, 0.25), 0.01);
+        double messageCost = roundTo(random.uniform(0.01, 0.10), 0.01);
+        double networkCharge = roundTo(random.uniform(0.05, 0.30), 0.01);
+        record.discountRate = static_cast<int32_t>(random.integer(0, 30));
+        record.plan = static_cast<int32_t>(plans(random));
+        record.talkingCharge = toMicros(talkingCharge);
+        record.messageCost = toMicros(messageCost);
+        record.networkCharge = toMicros(networkCharge);
+        binary.record(record);
+        json.element().raw("{\"ID\": ").integer(record.ID)
+            .raw(", \"talkingCharge\": ").number(talkingCharge, 2)
+            .raw(", \"messageCost\": ").number(messageCost, 2)
+            .raw(", \"networkCharge\": ").number(networkCharge, 2)
+            .raw(", \"discountRate\": ").integer(record.discountRate)
+            .raw(", \"plan\": ").string(PlanNames[record.plan]).raw("}");
+    }
+    json.endArray();
+
+    // Names are "Customer <ID>", so the pool can be written after the records
+    json.beginArray("customers");
+    binary.beginSection<CustomerRecord>(SectionKind::Customers, customerCount);
+    std::vector<double> operatorMix = options.operatorMix;
+    operatorMix.resize(operatorCount, options.operatorMix.empty() ? 1.0 : 0.0);
+    WeightedChoice operators(operatorMix);
+    WeightedChoice ageGroups(options.ageMix);
+    const int64_t ageRanges[3][2] = { { 12, 17 }, { 18, 65 }, { 66, 90 } };
+    uint64_t nameOffset = 0;
+    for (uint64_t i = 0; i < customerCount; ++i) {
+        std::string name = "Customer " + std::to_string(i);
+        size_t group = ageGroups(random);
+        CustomerRecord record = {};
+        record.ID = static_cast<int32_t>(i);
+        record.age = static_cast<int32_t>(random.integer(ageRanges[group][0], ageRanges[group][1]));
+        record.operatorID = static_cast<int32_t>(operators(random));
+        double billLimit = static_cast<double>(random.integer(20, 500));
+        record.billLimit = toMicros(billLimit);
+        record.nameOffset = nameOffset;
+        record.nameLength = static_cast<uint32_t>(name.size());
+        nameOffset += name.size();
+        binary.record(record);
+        json.element().raw("{\"ID\": ").integer(record.ID)
+            .raw(", \"name\": ").string(name)
+            .raw(", \"age\": ").integer(record.age)
+            .raw(", \"operatorID\": ").integer(record.operatorID)
+            .raw(", \"billLimit\": ").number(billLimit, 1).raw("}");
+    }
+    json.endArray();
+
+    binary.beginSection(SectionKind::NamePool, 1, nameOffset);
+    for (uint64_t i = 0; i < customerCount; ++i) {
+        std::string name = "Customer " + std::to_string(i);
+        binary.write(name.data(), name.size());
+    }
+
+    // Poisson arrivals over the period; callers and receivers are Zipfian
+    json.beginArray("actions");
+    binary.beginSection<ActionRecord>(SectionKind::Actions, options.actions);
+    ZipfDistribution popularity(customerCount, options.zipf);
+    WeightedChoice actionTypes(options.actionMix);
+    const double meanGap = static_cast<double>(options.days) * 86400.0 / std::max<uint64_t>(1, options.actions);
+    double time = 0.0;
+    for (uint64_t i = 0; i < options.actions; ++i) {
+        time += random.exponential(meanGap);
+        ActionRecord record = {};
+        record.type = static_cast<uint8_t>(actionTypes(random));
+        record.customerID = static_cast<int32_t>(popularity(random));
+        record.time = static_cast<int64_t>(time);
+        json.element().raw("{\"type\": ").string(ActionNames[record.type]).raw(", \"customerID\": ").integer(record.customerID);
+        switch (record.type) {
+        case 0:
+        case 1:
+            record.other = static_cast<int32_t>(popularity(random));
+            record.count = static_cast<int32_t>(std::min(120.0, 1.0 + random.exponential(record.type == 0 ? 5.0 : 2.0)));
+            json.raw(", \"otherCustomerID\": ").integer(record.other)
+                .raw(record.type == 0 ? ", \"minutes\": " : ", \"quantity\": ").integer(record.count);
+            break;
+        case 2:
+            record.amount = roundTo(random.exponential(40.0), 0.001);
+            json.raw(", \"amount\": ").number(record.amount, 3);
+            break;
+        case 3:
+            record.amount = roundTo(random.uniform(5.0, 100.0), 0.01);
+            json.raw(", \"amount\": ").number(record.amount, 2);
+            break;
+        case 4:
+            record.other = static_cast<int32_t>(operators(random));
+            json.raw(", \"newOperatorID\": ").integer(record.other);
+            break;
+        default:
+            record.amount = static_cast<double>(random.integer(20, 500));
+            json.raw(", \"newLimit\": ").number(record.amount, 1);
+            break;
+        }
+        json.raw(", \"time\": ").integer(record.time).raw("}");
+        binary.record(record);
+    }
+    json.endArray();
+}
+
+// Great-circle distance in km
+double haversine(double latitude1, double longitude1, double latitude2, double longitude2) {
+    const double toRadians = Pi / 180.0;
+    double dLatitude = (latitude2 - latitude1) * toRadians;
+    double dLongitude = (longitude2 - longitude1) * toRadians;
+    double a = std::sin(dLatitude / 2) * std::sin(dLatitude / 2)
+        + std::cos(latitude1 * toRadians) * std::cos(latitude2 * toRadians) * std::sin(dLongitude / 2) * std::sin(dLongitude / 2);
+    return 2.0 * 6371.0 * std::asin(std::min(1.0, std::sqrt(a)));
+}
+
+void writePort(JsonStream& json, const PortRecord& port) {
+    json.raw("{\"ID\": ").integer(port.ID).raw(", \"lat\": ").number(port.latitude, 4)
+        .raw(", \"lon\": ").number(port.longitude, 4).raw("}");
+}
+
+void writeShip(JsonStream& json, const ShipRecord& ship, bool withType) {
+    json.raw("{\"ID\": ").integer(ship.ID).raw(", \"portID\": ").integer(ship.portID);
+    if (withType) {
+        json.raw(", \"type\": ").string(ShipTypes[ship.type]);
+    }
+    json.raw(", \"totalWeightCapacity\": ").integer(ship.totalWeightCapacity)
+        .raw(", \"maxNumAllContainers\": ").integer(ship.maxNumAllContainers)
+        .raw(", \"maxNumHeavyContainers\": ").integer(ship.maxNumHeavyContainers)
+        .raw(", \"maxNumRefrigeratedContainers\": ").integer(ship.maxNumRefrigeratedContainers)
+        .raw(", \"maxNumLiquidContainers\": ").integer(ship.maxNumLiquidContainers)
+        .raw(", \"fuelConsumptionPerKM\": ").number(ship.fuelConsumptionPerKM, 1).raw("}");
+}
+
+void writeContainer(JsonStream& json, const ContainerRecord& container) {
+    json.raw("{\"ID\": ").integer(container.ID).raw(", \"weight\": ").integer(container.weight)
+        .raw(", \"type\": ").string(ContainerTypes[container.type]).raw(", \"portID\": ").integer(container.portID).raw("}");
+}
+
+// The arrays come first; "Port", "Ship", "Container" and "DestinationPort"
+// repeat the first records so the labs' main programs read the file as is
+void generateShipping(const GeneratorOptions& options, Random& random, JsonStream& json, BinaryStream& binary) {
+    const uint64_t portCount = std::max<uint64_t>(2, options.ports);
+    const uint64_t shipCount = std::max<uint64_t>(1, options.ships);
+    const uint64_t containerCount = std::max<uint64_t>(1, options.containers);
+
+    // Uniform over the sphere between 60 S and 70 N
+    std::vector<PortRecord> ports(portCount);
+    json.beginArray("Ports");
+    binary.beginSection<PortRecord>(SectionKind::Ports, portCount);
+    const double lowest = std::sin(-60.0 * Pi / 180.0);
+    const double highest = std::sin(70.0 * Pi / 180.0);
+    for (uint64_t i = 0; i < portCount; ++i) {
+        PortRecord& port = ports[i];
+        port.ID = static_cast<int32_t>(i);
+        port.latitude = roundTo(std::asin(random.uniform(lowest, highest)) * 180.0 / Pi, 0.0001);
+        port.longitude = roundTo(random.uniform(-180.0, 180.0), 0.0001);
+        binary.record(port);
+        writePort(json.element(), port);
+    }
+    json.endArray();
+
+    // A ring keeps the graph connected; the other routes go to Zipfian hubs
+    ZipfDistribution hubs(portCount, options.zipf);
+    const uint64_t routeCount = portCount * std::max<uint64_t>(1, options.routesPerPort);
+    json.beginArray("Routes");
+    binary.beginSection<RouteRecord>(SectionKind::Routes, routeCount);
+    for (uint64_t i = 0; i < routeCount; ++i) {
+        uint64_t from = i % portCount;
+        uint64_t to = i < portCount ? (from + 1) % portCount : hubs(random);
+        if (to == from) {
+            to = (from + 1 + random.next() % (portCount - 1)) % portCount;
+        }
+        RouteRecord route = { static_cast<int32_t>(from), static_cast<int32_t>(to),
+            roundTo(haversine(ports[from].latitude, ports[from].longitude, ports[to].latitude, ports[to].longitude), 0.1) };
+        binary.record(route);
+        json.element().raw("{\"from\": ").integer(route.from).raw(", \"to\": ").integer(route.to)
+            .raw(", \"distance\": ").number(route.distance, 1).raw("}");
+    }
+    json.endArray();
+
+    ShipRecord firstShip = {};
+    json.beginArray("Ships");
+    binary.beginSection<ShipRecord>(SectionKind::Ships, shipCount);
+    WeightedChoice shipTypes(options.shipMix);
+    for (uint64_t i = 0; i < shipCount; ++i) {
+        ShipRecord ship = {};
+        ship.ID = static_cast<int32_t>(i);
+        ship.portID = static_cast<int32_t>(hubs(random));
+        ship.type = static_cast<int32_t>(shipTypes(random));
+        const ShipPreset& preset = ShipPresets[ship.type];
+        ship.maxNumAllContainers = preset.maxNumAllContainers;
+        ship.maxNumHeavyContainers = preset.maxNumHeavyContainers;
+        ship.maxNumRefrigeratedContainers = preset.maxNumRefrigeratedContainers;
+        ship.maxNumLiquidContainers = preset.maxNumLiquidContainers;
+        ship.totalWeightCapacity = preset.maxNumAllContainers * 3000;
+        ship.fuelConsumptionPerKM = preset.fuelConsumptionPerKM;
+        binary.record(ship);
+        writeShip(json.element(), ship, options.lab == 3);
+        if (i == 0) {
+            firstShip = ship;
+        }
+    }
+    json.endArray();
+
+    // Basic containers weigh up to 3000, heavy ones more
+    ContainerRecord firstContainer = {};
+    json.beginArray("Containers");
+    binary.beginSection<ContainerRecord>(SectionKind::Containers, containerCount);
+    WeightedChoice containerTypes(options.containerMix);
+    for (uint64_t i = 0; i < containerCount; ++i) {
+        ContainerRecord container = {};
+        container.ID = static_cast<int32_t>(i);
+        container.type = static_cast<int32_t>(containerTypes(random));
+        container.weight = static_cast<int32_t>(container.type == 0 ? random.integer(500, 3000) : random.integer(3001, 6000));
+        container.portID = static_cast<int32_t>(hubs(random));
+        binary.record(container);
+        writeContainer(json.element(), container);
+        if (i == 0) {
+            firstContainer = container;
+        }
+    }
+    json.endArray();
+
+    if (options.lab == 3) {
+        const double weightRanges[4][2] = { { 0.5, 10.0 }, { 10.0, 200.0 }, { 1.0, 50.0 }, { 1.0, 100.0 } };
+        json.beginArray("Items");
+        binary.beginSection<ItemRecord>(SectionKind::Items, options.items);
+        WeightedChoice itemTypes(options.itemMix);
+        for (uint64_t i = 0; i < options.items; ++i) {
+            ItemRecord item = {};
+            item.ID = static_cast<int32_t>(i);
+            item.type = static_cast<uint8_t>(itemTypes(random));
+            item.containerID = static_cast<int32_t>(random.next() % containerCount);
+            item.weight = roundTo(random.uniform(weightRanges[item.type][0], weightRanges[item.type][1]), 0.1);
+            item.count = static_cast<int32_t>(random.integer(1, 20));
+            item.specificAttribute = random.chance(0.5) ? 1 : 0;
+            binary.record(item);
+            json.element().raw("{\"ID\": ").integer(item.ID).raw(", \"type\": ").string(ItemTypes[item.type])
+                .raw(", \"containerID\": ").integer(item.containerID).raw(", \"weight\": ").number(item.weight, 1)
+                .raw(", \"count\": ").integer(item.count).raw(", \"specificAttribute\": ").boolean(item.specificAttribute != 0).raw("}");
+        }
+        json.endArray();
+    }
+
+    writePort(json.member("Port"), ports[0]);
+    writeShip(json.member("Ship"), firstShip, options.lab == 3);
+    writeContainer(json.member("Container"), firstContainer);
+    writePort(json.member("DestinationPort"), ports[1]);
+}
+
+std::vector<double> parseMix(const char* text) {
+    std::vector<double> weights;
+    for (const char* p = text; *p != '\0';) {
+        char* end = nullptr;
+        weights.push_back(std::strtod(p, &end));
+        if (end == p) {
+            break;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return weights;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions options;
+    bool validArguments = true;
+    for (int i = 1; i < argc && validArguments; ++i) {
+        const std::string argument = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (argument == "--json-only") {
+            options.binary = false;
+            continue;
+        }
+        if (argument == "--binary-only") {
+            options.json = false;
+            continue;
+        }
+        if (value == nullptr) {
+            validArguments = false;
+            break;
+        }
+        ++i;
+        if (argument == "--lab") options.lab = std::atoi(value);
+        else if (argument == "--seed") options.seed = std::strtoull(value, nullptr, 10);
+        else if (argument == "--out") options.out = value;
+        else if (argument == "--zipf") options.zipf = std::strtod(value, nullptr);
+        else if (argument == "--customers") options.customers = std::strtoull(value, nullptr, 10);
+        else if (argument == "--operators") options.operators = std::strtoull(value, nullptr, 10);
+        else if (argument == "--actions") options.actions = std::strtoull(value, nullptr, 10);
+        else if (argument == "--days") options.days = std::strtoull(value, nullptr, 10);
+        else if (argument == "--operator-mix") options.operatorMix = parseMix(value);
+        else if (argument == "--plan-mix") options.planMix = parseMix(value);
+        else if (argument == "--age-mix") options.ageMix = parseMix(value);
+        else if (argument == "--action-mix") options.actionMix = parseMix(value);
+        else if (argument == "--ports") options.ports = std::strtoull(value, nullptr, 10);
+        else if (argument == "--routes-per-port") options.routesPerPort = std::strtoull(value, nullptr, 10);
+        else if (argument == "--ships") options.ships = std::strtoull(value, nullptr, 10);
+        else if (argument == "--containers") options.containers = std::strtoull(value, nullptr, 10);
+        else if (argument == "--items") options.items = std::strtoull(value, nullptr, 10);
+        else if (argument == "--ship-mix") options.shipMix = parseMix(value);
+        else if (argument == "--container-mix") options.containerMix = parseMix(value);
+        else if (argument == "--item-mix") options.itemMix = parseMix(value);
+        else validArguments = false;
+    }
+    validArguments = validArguments && options.lab >= 1 && options.lab <= 3 && options.zipf >= 0.0
+        && options.planMix.size() == 4 && options.ageMix.size() == 3 && options.actionMix.size() == 6
+        && options.shipMix.size() == 3 && options.containerMix.size() == 3 && options.itemMix.size() == 4;
+    if (!validArguments) {
+        std::cerr << "Usage: " << argv[0] << " --lab 1|2|3 [--seed N] [--out prefix] [--json-only | --binary-only] [--zipf S]\n"
+            << "  lab 1: [--customers N] [--operators N] [--actions N] [--days N] [--operator-mix w,...]\n"
+            << "         [--plan-mix standard,offpeak,volume,flat] [--age-mix under18,adult,over65]\n"
+            << "         [--action-mix talk,message,connect,pay,changeOperator,changeBillLimit]\n"
+            << "  lab 2, 3: [--ports N] [--routes-per-port N] [--ships N] [--containers N] [--items N]\n"
+            << "         [--ship-mix light,medium,heavy] [--container-mix basic,refrigerated,liquid]\n"
+            << "         [--item-mix small,heavy,refrigerated,liquid]" << std::endl;
+        return 1;
+    }
+
+    JsonStream json;
+    BinaryStream binary;
+    if (options.json && !json.open(options.out + ".json")) {
+        std::cerr << "Error: Unable to open " << options.out << ".json." << std::endl;
+        return 1;
+    }
+    if (options.binary && !binary.open(options.out + ".bin", static_cast<uint32_t>(options.lab), options.seed)) {
+        std::cerr << "Error: Unable to open " << options.out << ".bin." << std::endl;
+        return 1;
+    }
+
+    Random random(options.seed);
+    if (options.lab == 1) {
+        generateBilling(options, random, json, binary);
+    }
+    else {
+        generateShipping(options, random, json, binary);
+    }
+    json.end();
+    bool written = true;
+    if (!json.close()) {
+        std::cerr << "Error: Unable to write " << options.out << ".json." << std::endl;
+        written = false;
+    }
+    if (!binary.close()) {
+        std::cerr << "Error: Unable to write " << options.out << ".bin." << std::endl;
+        written = false;
+    }
+    return written ? 0 : 1;
+}